@@ -1,7 +1,82 @@
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "jack_midi_synth_app.h"
 #include "jack_midi_synth_logic.h"
+#include "jack_midi_synth_sample_manager.h"
+#include "jack_midi_synth_telemetry.h"
+
+void usage(const char* name) {
+  std::cerr << "Usage: " << name << " [-p polyphony] [-s oldest|quietest|same] [-t render_threads] [-e voices|soa] [-P patch_file] [-B bank_file] [-d preload_ms] [-c cache_dir] [-S stats_seconds] [-o stats_file]" << std::endl;
+  exit(1);
+}
 
 int main(int argc, char *argv[]) {
-  JackSynth my_app;
+  int polyphony = 32;
+  VoicePool::StealPolicy steal_policy = VoicePool::STEAL_OLDEST;
+  int render_threads = 0;
+  bool soa = false;
+  int stats_interval = 0;
+  const char* stats_filename = nullptr;
+  const char* patch_filename = nullptr;
+  const char* bank_filename = nullptr;
+  float preload = 0.0;
+  const char* cache_directory = nullptr;
+  int option;
+  while ((option = getopt(argc, argv, "p:s:t:S:o:e:P:B:d:c:")) != -1) {
+    if (option == 'p') {
+      polyphony = atoi(optarg);
+    } else if (option == 't') {
+      render_threads = atoi(optarg);
+    } else if (option == 'S') {
+      stats_interval = atoi(optarg);
+    } else if (option == 'o') {
+      stats_filename = optarg;
+    } else if (option == 'P') {
+      patch_filename = optarg;
+    } else if (option == 'B') {
+      bank_filename = optarg;
+    } else if (option == 'd') {
+      preload = atof(optarg);
+    } else if (option == 'c') {
+      cache_directory = optarg;
+    } else if (option == 'e' && strcmp(optarg, "voices") == 0) {
+      soa = false;
+    } else if (option == 'e' && strcmp(optarg, "soa") == 0) {
+      soa = true;
+    } else if (option == 's' && strcmp(optarg, "oldest") == 0) {
+      steal_policy = VoicePool::STEAL_OLDEST;
+    } else if (option == 's' && strcmp(optarg, "quietest") == 0) {
+      steal_policy = VoicePool::STEAL_QUIETEST;
+    } else if (option == 's' && strcmp(optarg, "same") == 0) {
+      steal_policy = VoicePool::STEAL_SAME_NOTE;
+    } else {
+      usage(argv[0]);
+    }
+  }
+  // Samples longer than the preload stream from disk.
+  SampleManager::get().setPreload(preload);
+  // Decoded samples are kept in the cache directory and mapped on later
+  // starts.
+  if (cache_directory && !SampleManager::get().setCacheDirectory(cache_directory)) exit(1);
+  JackSynth synth(polyphony, steal_policy, render_threads, soa);
+  if (bank_filename && !synth.loadBank(bank_filename)) exit(1);
+  if (patch_filename && !synth.loadPatch(patch_filename)) exit(1);
+  JackApp my_app(&synth);
+  Telemetry telemetry;
+  std::ofstream stats_file;
+  if (stats_filename) {
+    stats_file.open(stats_filename, std::ios::app);
+    if (!stats_file) {
+      std::cerr << "Unable to open " << stats_filename << std::endl;
+      exit(1);
+    }
+  }
+  if (stats_interval > 0) my_app.setTelemetry(&telemetry, stats_filename ? &stats_file : &std::cerr, stats_interval);
   my_app.activate();
   my_app.run();
   return 0;
@@ -1,12 +1,20 @@
 #include <iostream>
+#include <cstdlib>
 #include <unistd.h>
 
 #include <jack/jack.h>
+#include <jack/midiport.h>
 
 #include "jack_midi_synth_app.h"
+#include "jack_midi_synth_telemetry.h"
+#include "jack_midi_synth_profiler.h"
 
 
-JackApp::JackApp() : sample_rate (0), buffer_size (0) {
+const int kMaxMidiEvents = 1024;
+const int kProfileInterval = 10;
+
+
+JackApp::JackApp(AudioProcessor* init_processor) : AudioBackend(init_processor) {
   jack_set_error_function(JackApp::error);
   client = jack_client_open("Midi Synth", JackNoStartServer, NULL);
   if (!client) {
@@ -15,40 +23,101 @@ JackApp::JackApp() : sample_rate (0), buffer_size (0) {
   }
   sample_rate = jack_get_sample_rate(client);
   buffer_size = jack_get_buffer_size(client);
+  midi_events.reserve(kMaxMidiEvents);
   jack_set_process_callback(client, JackApp::static_process, this);
   jack_set_sample_rate_callback(client, JackApp::static_srate, this);
   jack_set_buffer_size_callback(client, JackApp::static_bsize, this);
+  jack_set_xrun_callback(client, JackApp::static_xrun, this);
   jack_on_shutdown(client, JackApp::static_jack_shutdown, this);
+  add_ports();
 }
 
 JackApp::~JackApp() {
   jack_client_close(client);
 }
 
+void JackApp::activate() {
+  processor->activate(sample_rate, buffer_size, jack_client_real_time_priority(client));
+  if (jack_activate(client)) {
+    std::cerr << "Unable to activate client" << std::endl;
+    exit(1);
+  }
+  connect_ports();
+}
+
 int JackApp::static_process(jack_nframes_t nframes, void *arg) {
   JackApp* o = reinterpret_cast<JackApp*>(arg);
   return o->process(nframes);
 }
 
-void JackApp::run() const {
-  for(;;) sleep(1);
+int JackApp::process(jack_nframes_t nframes) {
+  auto in = jack_port_get_buffer(midi_input_port, nframes);
+  midi_events.clear();
+  for (int i=0; i < jack_midi_get_event_count(in) && i < kMaxMidiEvents; ++i) {
+    jack_midi_event_t event;
+    jack_midi_event_get(&event, in, i);
+    midi_events.push_back(MidiEvent(event.time, event.size, event.buffer));
+  }
+  auto out = reinterpret_cast<float*>(jack_port_get_buffer(audio_output_port, nframes));
+  return processCycle(midi_events.data(), midi_events.size(), out, nframes);
+}
+
+void JackApp::run() {
+  for(int second=1;; ++second) {
+    sleep(1);
+    processor->idle();
+    if (telemetry) telemetry->drain();
+    if (second % (telemetry ? telemetry_interval : kProfileInterval)) continue;
+    if (telemetry) telemetry->report(*telemetry_out);
+    PROFILE_REPORT(telemetry ? *telemetry_out : std::cerr);
+  }
 }
 
 int JackApp::static_srate(jack_nframes_t nframes, void *arg) {
   JackApp* o = reinterpret_cast<JackApp*>(arg);
-  return o->srate(nframes);
+  o->sample_rate = nframes;
+  return o->processor->srate(nframes);
 }
 
 int JackApp::static_bsize(jack_nframes_t nframes, void *arg) {
   JackApp* o = reinterpret_cast<JackApp*>(arg);
-  return o->bsize(nframes);
+  o->buffer_size = nframes;
+  return o->processor->bsize(nframes);
 }
 
 void JackApp::error(const char *desc) {
   std::cerr << "JACK error: " << desc << std::endl;
 }
 
+int JackApp::static_xrun(void *arg) {
+  JackApp* o = reinterpret_cast<JackApp*>(arg);
+  if (o->telemetry) o->telemetry->recordXrun();
+  return 0;
+}
+
 void JackApp::static_jack_shutdown(void *arg) {
   JackApp* o = reinterpret_cast<JackApp*>(arg);
-  o->jack_shutdown();
+  o->processor->shutdown();
+}
+
+void JackApp::add_ports() {
+  midi_input_port = jack_port_register(client, "midi_input", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
+  audio_output_port = jack_port_register(client, "audio_output", JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+}
+
+void JackApp::connect_ports() {
+  const char **ports;
+
+  if((ports = jack_get_ports(client, NULL, JACK_DEFAULT_AUDIO_TYPE, JackPortIsPhysical|JackPortIsTerminal|JackPortIsInput)) == NULL) {
+    std::cerr << "Cannot find any physical playback ports" << std::endl;
+    return;
+  }
+
+  for (int i=0; ports[i]; ++i) {
+    if(jack_connect(client, jack_port_name(audio_output_port), ports[i])) {
+      std::cerr << "cannot connect output ports" << std::endl;
+    }
+  }
+
+  jack_free(ports);
 }
@@ -1,29 +1,32 @@
 #ifndef JACK_MIDI_SYNTH_APP_H
 #define JACK_MIDI_SYNTH_APP_H
 
-class Voice;
-struct FloatEvent;
+#include <vector>
 
 #include <jack/types.h>
 
-class JackApp {
+#include "jack_midi_synth_backend.h"
+
+class JackApp : public AudioBackend {
   protected:
     jack_client_t *client;
-    jack_nframes_t sample_rate;
-    jack_nframes_t buffer_size;
+    jack_port_t *midi_input_port;
+    jack_port_t *audio_output_port;
+    std::vector<MidiEvent> midi_events;
   public:
-    JackApp();
+    JackApp(AudioProcessor*);
     ~JackApp();
-    void run() const;
+    virtual void activate() override;
+    virtual void run() override;
+    void add_ports();
+    void connect_ports();
     static int static_srate(jack_nframes_t, void*);
     static int static_bsize(jack_nframes_t, void*);
     static void error(const char*);
     static void static_jack_shutdown(void*);
+    static int static_xrun(void*);
     static int static_process(jack_nframes_t, void*);
-    virtual int srate(jack_nframes_t) {};
-    virtual int bsize(jack_nframes_t) {};
-    virtual int process(jack_nframes_t) {};
-    virtual void jack_shutdown() {};
+    int process(jack_nframes_t);
 };
 
 #endif  // JACK_MIDI_SYNTH_APP_H
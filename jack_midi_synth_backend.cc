@@ -0,0 +1,22 @@
+#include <ctime>
+
+#include "jack_midi_synth_backend.h"
+#include "jack_midi_synth_telemetry.h"
+
+
+void AudioBackend::setTelemetry(Telemetry* new_telemetry, std::ostream* out, int interval) {
+  telemetry = new_telemetry;
+  telemetry_out = out;
+  telemetry_interval = interval > 0 ? interval : 1;
+}
+
+int AudioBackend::processCycle(const MidiEvent* events, int event_count, float* out, int nframes) {
+  if (!telemetry) return processor->process(events, event_count, out, nframes);
+  timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  int result = processor->process(events, event_count, out, nframes);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  float seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+  telemetry->recordCycle(seconds, static_cast<float>(nframes) / sample_rate, processor->getActiveVoices());
+  return result;
+}
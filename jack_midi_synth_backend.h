@@ -0,0 +1,53 @@
+#ifndef JACK_MIDI_SYNTH_BACKEND_H
+#define JACK_MIDI_SYNTH_BACKEND_H
+
+#include <ostream>
+
+class Telemetry;
+
+// The engine only sees these two interfaces, so it can be driven by JACK or
+// by anything else that can hand it MIDI and collect audio a block at a
+// time.
+
+struct MidiEvent {
+  MidiEvent() : time(0), size(0), buffer(nullptr) {}
+  MidiEvent(int init_time, int init_size, const unsigned char* init_buffer) : time(init_time), size(init_size), buffer(init_buffer) {}
+  int time;
+  int size;
+  const unsigned char* buffer;
+};
+
+
+class AudioProcessor {
+  public:
+    virtual ~AudioProcessor() {}
+    virtual void activate(int, int, int) = 0;
+    virtual int srate(int) { return 0; }
+    virtual int bsize(int) { return 0; }
+    virtual int process(const MidiEvent*, int, float*, int) = 0;
+    virtual void shutdown() {}
+    virtual void idle() {}
+    virtual int getActiveVoices() const { return 0; }
+};
+
+
+class AudioBackend {
+  protected:
+    AudioProcessor* processor;
+    int sample_rate;
+    int buffer_size;
+    Telemetry* telemetry;
+    std::ostream* telemetry_out;
+    int telemetry_interval;
+    int processCycle(const MidiEvent*, int, float*, int);
+  public:
+    AudioBackend(AudioProcessor* init_processor) : processor(init_processor), sample_rate(0), buffer_size(0), telemetry(nullptr), telemetry_out(nullptr), telemetry_interval(0) {}
+    virtual ~AudioBackend() {}
+    virtual void activate() = 0;
+    virtual void run() = 0;
+    void setTelemetry(Telemetry*, std::ostream*, int=10);
+    int getSampleRate() const { return sample_rate; }
+    int getBufferSize() const { return buffer_size; }
+};
+
+#endif // JACK_MIDI_SYNTH_BACKEND_H
@@ -0,0 +1,349 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <functional>
+#include <memory>
+#include <chrono>
+#include <cstdlib>
+#include <cmath>
+
+#include <unistd.h>
+
+#include "jack_midi_synth_convolution.h"
+#include "jack_midi_synth_envelopes.h"
+#include "jack_midi_synth_events.h"
+#include "jack_midi_synth_fast_math.h"
+#include "jack_midi_synth_filters.h"
+#include "jack_midi_synth_logic.h"
+#include "jack_midi_synth_oscillators.h"
+#include "jack_midi_synth_sample_manager.h"
+#include "jack_midi_synth_static_voice.h"
+#include "jack_midi_synth_voice.h"
+#include "jack_midi_synth_wavetable.h"
+
+// Microbenchmarks for the DSP building blocks and the whole engine. Every
+// case is run at each block size until it has taken at least the minimum
+// time, and reported as nanoseconds per output sample.
+
+const int kBlockSizes[] = {32, 64, 128, 256, 512, 1024};
+const int kVoiceCounts[] = {1, 16, 64, 128};
+
+struct BenchResult {
+  std::string name;
+  int frames;
+  int voices;
+  double ns_per_sample;
+};
+
+class BenchRunner {
+  private:
+    std::string filter;
+    double min_time;
+    int sample_rate;
+    std::vector<BenchResult> results;
+  public:
+    BenchRunner(const std::string& init_filter, double init_min_time, int init_sample_rate) : filter(init_filter), min_time(init_min_time), sample_rate(init_sample_rate) {}
+    int getSampleRate() const { return sample_rate; }
+    bool wants(const std::string& name) const { return name.find(filter) != std::string::npos; }
+    void measure(const std::string&, int, int, const std::function<void()>&);
+    void summary(int) const;
+    const BenchResult& last() const { return results.back(); }
+};
+
+void BenchRunner::measure(const std::string& name, int frames, int voices, const std::function<void()>& body) {
+  body();
+  long iterations = 1;
+  double elapsed = 0.0;
+  for (;;) {
+    auto start = std::chrono::steady_clock::now();
+    for (long i=0; i < iterations; ++i) body();
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (elapsed >= min_time) break;
+    iterations *= 2;
+  }
+  BenchResult result = {name, frames, voices, elapsed * 1e9 / (static_cast<double>(iterations) * frames)};
+  results.push_back(result);
+  std::cout << std::left << std::setw(40) << name << std::right << std::setw(6) << frames << std::setw(12) << std::fixed << std::setprecision(2) << result.ns_per_sample << " ns/sample";
+  if (voices > 0) std::cout << std::setw(10) << std::setprecision(1) << 1e9 / sample_rate / (result.ns_per_sample / voices) << " voices/core";
+  std::cout << std::endl;
+}
+
+void BenchRunner::summary(int period) const {
+  double period_us = 1e6 * period / sample_rate;
+  std::cout << std::endl << "At a " << period << " frame period (" << std::setprecision(0) << period_us << " us at " << sample_rate << " Hz):" << std::endl;
+  for (const auto& result: results) {
+    if (result.frames != period || result.voices == 0) continue;
+    double used = result.ns_per_sample * period / 1000.0;
+    std::cout << "  " << std::left << std::setw(38) << result.name << std::right << std::setprecision(1) << std::setw(8) << 100.0 * used / period_us << "% of the period, " << std::setw(8) << result.voices * period_us / used << " voices per core" << std::endl;
+  }
+}
+
+
+void benchOscillator(BenchRunner& runner, const char* name, Oscillator* oscillator) {
+  std::string label = std::string("Oscillator/") + name;
+  // Samples load in the background, and Audio takes one on reset.
+  SampleManager::get().waitForLoads(std::cerr);
+  oscillator->reset();
+  if (runner.wants(label)) {
+    for (int frames: kBlockSizes) {
+      std::vector<float> phase_steps(frames, 261.6 / runner.getSampleRate());
+      std::vector<float> out(frames);
+      runner.measure(label, frames, 0, [&]() { oscillator->render(phase_steps.data(), out.data(), frames); });
+    }
+  }
+  if (runner.wants(label + "/steady")) {
+    for (int frames: kBlockSizes) {
+      std::vector<float> out(frames);
+      runner.measure(label + "/steady", frames, 0, [&]() { oscillator->renderSteady(261.6 / runner.getSampleRate(), out.data(), frames); });
+    }
+  }
+  delete oscillator;
+}
+
+void benchEnvelope(BenchRunner& runner, const char* name, Envelope* envelope) {
+  std::string label = std::string("Envelope/") + name;
+  if (runner.wants(label)) {
+    envelope->setSampleRate(runner.getSampleRate());
+    for (int frames: kBlockSizes) {
+      std::vector<float> weights(frames);
+      // Pushed down at the start of every two seconds and lifted up a
+      // second in, on the block that reaches each point, so every block
+      // size runs through attack, sustain and release.
+      int rendered = 0;
+      int cycle = 2 * runner.getSampleRate();
+      runner.measure(label, frames, 0, [&]() {
+        if (rendered == 0) envelope->pushDown();
+        if (rendered < runner.getSampleRate() && rendered + frames >= runner.getSampleRate()) envelope->liftUp();
+        envelope->render(weights.data(), frames);
+        rendered += frames;
+        if (rendered >= cycle) rendered = 0;
+      });
+    }
+  }
+  delete envelope;
+}
+
+void benchFilter(BenchRunner& runner, const std::string& label, Filter* filter) {
+  if (runner.wants(label)) {
+    filter->setSampleRate(runner.getSampleRate());
+    for (int frames: kBlockSizes) {
+      std::vector<float> samples(frames);
+      for (int i=0; i < frames; ++i) samples[i] = (i % 100) / 50.0 - 1.0;
+      runner.measure(label, frames, 0, [&]() {
+        for (int i=0; i < frames; ++i) filter->process(samples[i]);
+      });
+    }
+  }
+  if (runner.wants(label + "/block")) {
+    filter->setSampleRate(runner.getSampleRate());
+    for (int frames: kBlockSizes) {
+      std::vector<float> samples(frames);
+      for (int i=0; i < frames; ++i) samples[i] = (i % 100) / 50.0 - 1.0;
+      runner.measure(label + "/block", frames, 0, [&]() {
+        filter->process(samples.data(), frames);
+      });
+    }
+  }
+  delete filter;
+}
+
+// Sweeps the cutoff across the whole range every block, as a filter
+// envelope would.
+void benchModulatedFilter(BenchRunner& runner, const std::string& label, Filter* filter) {
+  if (runner.wants(label)) {
+    filter->setSampleRate(runner.getSampleRate());
+    for (int frames: kBlockSizes) {
+      std::vector<float> samples(frames);
+      std::vector<float> cutoff_offsets(frames);
+      std::vector<float> resonance_offsets(frames, 0.0);
+      for (int i=0; i < frames; ++i) {
+        samples[i] = (i % 100) / 50.0 - 1.0;
+        cutoff_offsets[i] = static_cast<float>(i) / frames - 0.5;
+      }
+      runner.measure(label, frames, 0, [&]() {
+        filter->processModulated(samples.data(), cutoff_offsets.data(), resonance_offsets.data(), frames);
+      });
+    }
+  }
+  delete filter;
+}
+
+// Decaying noise responses of a few lengths. The bench runs faster than
+// real time, so process ends up waiting on the tail thread and the figure
+// is the cost of whichever of the two threads is slower.
+void benchConvolution(BenchRunner& runner) {
+  for (int seconds: {1, 2, 4}) {
+    std::string label = "Convolution/ir_seconds:" + std::to_string(seconds);
+    if (!runner.wants(label)) continue;
+    std::vector<float> response(seconds * runner.getSampleRate());
+    srand(1);
+    for (int i=0; i < response.size(); ++i) response[i] = (rand() / (RAND_MAX / 2.0) - 1.0) * exp(-6.9 * i / response.size());
+    Convolution convolution(response, 0.3);
+    for (int frames: kBlockSizes) {
+      std::vector<float> samples(frames);
+      for (int i=0; i < frames; ++i) samples[i] = (i % 100) / 50.0 - 1.0;
+      runner.measure(label, frames, 0, [&]() { convolution.process(samples.data(), frames); });
+      std::cout << std::setw(58) << std::setprecision(2) << runner.last().ns_per_sample / seconds << " ns/sample per second of response" << std::endl;
+    }
+  }
+}
+
+void benchInterpolateEvents(BenchRunner& runner, JackSynth& synth) {
+  for (int event_count: {0, 1, 8, 32}) {
+    std::string label = "JackSynth::interpolateEvents/events:" + std::to_string(event_count);
+    if (!runner.wants(label)) continue;
+    for (int frames: kBlockSizes) {
+      EventLane events(0.0);
+      events.cycle(frames);
+      for (int i=0; i < event_count; ++i) events.push((i * frames) / event_count, (i % 2) ? 1.0 : 0.0);
+      ControllerLane values;
+      values.resize(frames);
+      runner.measure(label, frames, 0, [&]() { synth.interpolateEvents(events, values); });
+    }
+  }
+}
+
+// With moving set every controller lane carries a full buffer, as it does
+// during a controller sweep; otherwise they are all constant.
+void benchVoice(BenchRunner& runner, const std::string& name, std::function<VoiceBase*()> create, bool moving) {
+  std::string label = name + (moving ? "::render/moving" : "::render");
+  if (!runner.wants(label)) return;
+  for (int frames: kBlockSizes) {
+    std::unique_ptr<VoiceBase> voice_holder(create());
+    VoiceBase& voice = *voice_holder;
+    voice.setSampleRate(runner.getSampleRate());
+    voice.setBufferSize(frames);
+    ControllerLane zeros, ones;
+    zeros.resize(frames);
+    ones.resize(frames);
+    zeros.setConstant(0.0);
+    ones.setConstant(1.0);
+    if (moving) {
+      float* zero_values = zeros.setVarying();
+      float* one_values = ones.setVarying();
+      std::fill(zero_values, zero_values + frames, 0.0);
+      std::fill(one_values, one_values + frames, 1.0);
+    }
+    std::vector<float> out(frames);
+    std::vector<float> send(frames);
+    voice.triggerVoice(60, 0.8, 0);
+    int global_frame = 0;
+    runner.measure(label, frames, 1, [&]() {
+      voice.update(&zeros, &ones, &zeros, &ones, &zeros, &zeros);
+      voice.render(out.data(), send.data(), global_frame, frames);
+      global_frame += frames;
+    });
+  }
+}
+
+void benchProcess(BenchRunner& runner, int render_threads, bool soa) {
+  for (int voices: kVoiceCounts) {
+    std::string label = "JackSynth::process/voices:" + std::to_string(voices);
+    if (soa) label += "/soa";
+    else if (render_threads > 0) label += "/threads:" + std::to_string(render_threads);
+    if (!runner.wants(label)) continue;
+    for (int frames: kBlockSizes) {
+      JackSynth synth(voices, VoicePool::STEAL_OLDEST, render_threads, soa);
+      synth.activate(runner.getSampleRate(), frames, 0);
+      std::vector<unsigned char> note_ons(3 * voices);
+      std::vector<MidiEvent> events;
+      for (int i=0; i < voices; ++i) {
+        note_ons[3 * i] = 0x90;
+        note_ons[3 * i + 1] = (24 + i * 7) % 128;
+        note_ons[3 * i + 2] = 100;
+        events.push_back(MidiEvent(0, 3, note_ons.data() + 3 * i));
+      }
+      std::vector<float> out(frames);
+      synth.process(events.data(), events.size(), out.data(), frames);
+      runner.measure(label, frames, voices, [&]() { synth.process(nullptr, 0, out.data(), frames); });
+    }
+  }
+}
+
+template <class Function>
+void benchMath(BenchRunner& runner, const char* name, float low, float high, Function function) {
+  std::string label = std::string("Math/") + name;
+  if (!runner.wants(label)) return;
+  for (int frames: kBlockSizes) {
+    std::vector<float> in(frames);
+    std::vector<float> out(frames);
+    for (int i=0; i < frames; ++i) in[i] = low + (high - low) * i / frames;
+    runner.measure(label, frames, 0, [&]() {
+      for (int i=0; i < frames; ++i) out[i] = function(in[i]);
+    });
+  }
+}
+
+void usage(const char* name) {
+  std::cerr << "Usage: " << name << " [-f filter] [-m min_seconds] [-r sample_rate] [-P period] [-t render_threads]" << std::endl;
+  exit(1);
+}
+
+int main(int argc, char *argv[]) {
+  std::string filter;
+  double min_time = 0.05;
+  int sample_rate = 48000;
+  int period = 64;
+  int render_threads = 0;
+  int option;
+  while ((option = getopt(argc, argv, "f:m:r:P:t:")) != -1) {
+    if (option == 'f') {
+      filter = optarg;
+    } else if (option == 'm') {
+      min_time = atof(optarg);
+    } else if (option == 'r') {
+      sample_rate = atoi(optarg);
+    } else if (option == 'P') {
+      period = atoi(optarg);
+    } else if (option == 't') {
+      render_threads = atoi(optarg);
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (sample_rate <= 0 || period <= 0) usage(argv[0]);
+
+  BenchRunner runner(filter, min_time, sample_rate);
+  benchOscillator(runner, "Sine", new Sine());
+  benchOscillator(runner, "Pulse", new Pulse());
+  benchOscillator(runner, "Triangle", new Triangle());
+  benchOscillator(runner, "Saw", new Saw());
+  benchOscillator(runner, "ReverseSaw", new ReverseSaw());
+  benchOscillator(runner, "Noise", new Noise());
+  benchOscillator(runner, "Audio", new Audio("test.wav"));
+  benchOscillator(runner, "Audio/linear", new Audio("test.wav", Audio::INTERPOLATION_LINEAR));
+  benchOscillator(runner, "Audio/cubic", new Audio("test.wav", Audio::INTERPOLATION_CUBIC));
+  benchOscillator(runner, "Audio/sinc", new Audio("test.wav", Audio::INTERPOLATION_SINC));
+  benchOscillator(runner, "Wavetable/sine", new WavetableOscillator(&Wavetable::get(Wavetable::WAVE_SINE)));
+  benchOscillator(runner, "Wavetable/saw", new WavetableOscillator(&Wavetable::get(Wavetable::WAVE_SAW)));
+  benchMath(runner, "tanh", -4.0, 4.0, [](float x) { return static_cast<float>(tanh(x)); });
+  benchMath(runner, "fastTanh", -4.0, 4.0, fastTanh);
+  benchMath(runner, "pow2", -1.0, 1.0, [](float x) { return static_cast<float>(pow(2.0, x)); });
+  benchMath(runner, "fastExp2", -1.0, 1.0, fastExp2);
+  benchMath(runner, "fmod", 0.0, 2.0, [](float x) { return static_cast<float>(fmod(x, 1.0)); });
+  benchMath(runner, "wrapPhase", 0.0, 2.0, wrapPhase);
+  benchEnvelope(runner, "Constant", new Constant(0.5));
+  benchEnvelope(runner, "LAD", new LAD(0.05, 0.5));
+  benchEnvelope(runner, "LADSR", new LADSR(0.05, 0.25, 0.5, 0.8, 0.02));
+  benchEnvelope(runner, "DL4R4", new DL4R4(1.0, 0.05, 0.6, 0.1, 0.4, 0.2, 0.0, 0.5, 0.01));
+  for (int order: {1, 2, 4, 8}) {
+    benchFilter(runner, "Pass/order:" + std::to_string(order), new Pass(Pass::FILTER_MODE_LOWPASS, order));
+  }
+  benchFilter(runner, "StateVariable", new StateVariable(Pass::FILTER_MODE_LOWPASS, 0.5, 0.5));
+  benchModulatedFilter(runner, "Pass/modulated", new Pass(Pass::FILTER_MODE_LOWPASS, 2));
+  benchModulatedFilter(runner, "StateVariable/modulated", new StateVariable(Pass::FILTER_MODE_LOWPASS, 0.5, 0.5));
+  benchFilter(runner, "Delay", new Delay(0.1, 0.7));
+  benchConvolution(runner);
+  JackSynth synth;
+  synth.activate(sample_rate, 1024, 0);
+  benchInterpolateEvents(runner, synth);
+  benchVoice(runner, "Voice", []() { return new Voice(); }, false);
+  benchVoice(runner, "Voice", []() { return new Voice(); }, true);
+  benchVoice(runner, "StaticVoice", []() { return newDefaultStaticVoice(); }, false);
+  benchVoice(runner, "StaticVoice", []() { return newDefaultStaticVoice(); }, true);
+  benchProcess(runner, render_threads, false);
+  benchProcess(runner, 0, true);
+  runner.summary(period);
+  return 0;
+}
@@ -0,0 +1,153 @@
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "jack_midi_synth_convolution.h"
+
+
+UniformConvolver::UniformConvolver(const float* response, int length, int init_partition) : partition(init_partition), bins(init_partition + 1), partitions(std::max((length + init_partition - 1) / init_partition, 1)), history_index(0), fft(2 * init_partition), filter_real(partitions * bins), filter_imag(partitions * bins), history_real(partitions * bins, 0.0), history_imag(partitions * bins, 0.0), sum_real(bins), sum_imag(bins), spectrum(bins), window(2 * init_partition, 0.0), result(2 * init_partition) {
+  // Each partition of the response is zero-padded to the transform size.
+  for (int p=0; p < partitions; ++p) {
+    std::fill(result.begin(), result.end(), 0.0);
+    int count = std::max(std::min(partition, length - p * partition), 0);
+    std::copy(response + p * partition, response + p * partition + count, result.begin());
+    fft.forward(result.data(), spectrum.data());
+    for (int bin=0; bin < bins; ++bin) {
+      filter_real[p * bins + bin] = spectrum[bin].real();
+      filter_imag[p * bins + bin] = spectrum[bin].imag();
+    }
+  }
+}
+
+// The window holds the previous partition of input and this one; the last
+// half of its circular convolution with the response is the output.
+void UniformConvolver::process(const float* in, float* out) {
+  std::copy(window.begin() + partition, window.end(), window.begin());
+  std::copy(in, in + partition, window.begin() + partition);
+  fft.forward(window.data(), spectrum.data());
+  float* current_real = history_real.data() + history_index * bins;
+  float* current_imag = history_imag.data() + history_index * bins;
+  for (int bin=0; bin < bins; ++bin) {
+    current_real[bin] = spectrum[bin].real();
+    current_imag[bin] = spectrum[bin].imag();
+  }
+  std::fill(sum_real.begin(), sum_real.end(), 0.0);
+  std::fill(sum_imag.begin(), sum_imag.end(), 0.0);
+  for (int p=0; p < partitions; ++p) {
+    int slot = history_index - p;
+    if (slot < 0) slot += partitions;
+    const float* x_real = history_real.data() + slot * bins;
+    const float* x_imag = history_imag.data() + slot * bins;
+    const float* h_real = filter_real.data() + p * bins;
+    const float* h_imag = filter_imag.data() + p * bins;
+    for (int bin=0; bin < bins; ++bin) {
+      sum_real[bin] += x_real[bin] * h_real[bin] - x_imag[bin] * h_imag[bin];
+      sum_imag[bin] += x_real[bin] * h_imag[bin] + x_imag[bin] * h_real[bin];
+    }
+  }
+  for (int bin=0; bin < bins; ++bin) spectrum[bin] = std::complex<float>(sum_real[bin], sum_imag[bin]);
+  fft.inverse(spectrum.data(), result.data());
+  std::copy(result.begin() + partition, result.end(), out);
+  if (++history_index == partitions) history_index = 0;
+}
+
+
+// The tail partition that makes the head's cost (two tail partitions of
+// head partitions) about match the tail's (one multiply-add per bin per
+// tail partition of response), up to kMaxTailPartition.
+int Convolution::getTailPartition(int length) {
+  int partition = 4 * kHeadPartition;
+  while (8L * partition * partition <= static_cast<long>(length) * kHeadPartition && partition < kMaxTailPartition) partition *= 2;
+  return partition;
+}
+
+Convolution::Convolution(const std::vector<float>& response, float init_wet) : Filter("Convolution"), wet(init_wet), head(response.data(), std::min<int>(response.size(), 2 * getTailPartition(response.size())), kHeadPartition), tail(nullptr), tail_start(2 * getTailPartition(response.size())), frames(0), fill(0), head_input(kHeadPartition, 0.0), head_output(kHeadPartition, 0.0), running(true) {
+  setParameter(PARAMETER_WET, init_wet);
+  if (response.size() <= tail_start) return;
+  int tail_partition = tail_start / 2;
+  tail = new UniformConvolver(response.data() + tail_start, response.size() - tail_start, tail_partition);
+  for (int i=0; i < 2; ++i) {
+    tail_input[i].assign(tail_partition, 0.0);
+    tail_output[i].assign(tail_partition, 0.0);
+  }
+  sem_init(&wake, 0, 0);
+  sem_init(&done, 0, 0);
+  // The tail thread runs at normal priority, behind the process thread.
+  if (pthread_create(&thread, NULL, Convolution::static_work, this)) {
+    std::cerr << "Unable to start convolution thread" << std::endl;
+    exit(1);
+  }
+}
+
+Convolution::~Convolution() {
+  if (!tail) return;
+  running = false;
+  sem_post(&wake);
+  pthread_join(thread, NULL);
+  sem_destroy(&wake);
+  sem_destroy(&done);
+  delete tail;
+}
+
+void* Convolution::static_work(void* arg) {
+  reinterpret_cast<Convolution*>(arg)->work();
+  return NULL;
+}
+
+// Tail partitions are handed over and finished strictly in turn, each in
+// the buffer pair for its parity.
+void Convolution::work() {
+  for (long job=0; ; ++job) {
+    sem_wait(&wake);
+    if (!running) return;
+    tail->process(tail_input[job % 2].data(), tail_output[job % 2].data());
+    sem_post(&done);
+  }
+}
+
+// Convolves the head partition just filled and adds the matching stretch
+// of the tail, waiting for the thread only on the first frame of a tail
+// partition. Then feeds the input to the tail, posting it once a whole
+// tail partition is in.
+void Convolution::processPartition() {
+  head.process(head_input.data(), head_output.data());
+  if (tail) {
+    int tail_partition = tail->getPartition();
+    if (frames >= tail_start) {
+      long offset = frames - tail_start;
+      if (offset % tail_partition == 0) sem_wait(&done);
+      const float* tail_block = tail_output[(offset / tail_partition) % 2].data() + offset % tail_partition;
+      for (int i=0; i < kHeadPartition; ++i) head_output[i] += tail_block[i];
+    }
+    std::copy(head_input.begin(), head_input.end(), tail_input[(frames / tail_partition) % 2].begin() + frames % tail_partition);
+    if ((frames + kHeadPartition) % tail_partition == 0) sem_post(&wake);
+  }
+  frames += kHeadPartition;
+}
+
+void Convolution::process(float* values, int length) {
+  float dry = 1.0f - wet;
+  int frame = 0;
+  while (frame < length) {
+    int count = std::min(kHeadPartition - fill, length - frame);
+    for (int i=0; i < count; ++i) {
+      head_input[fill + i] = values[frame + i];
+      values[frame + i] = dry * values[frame + i] + wet * head_output[fill + i];
+    }
+    fill += count;
+    frame += count;
+    if (fill == kHeadPartition) {
+      processPartition();
+      fill = 0;
+    }
+  }
+}
+
+void Convolution::setParameter(int parameter, float value) {
+  switch (parameter) {
+    case PARAMETER_WET:
+      wet = std::min(std::max(value, 0.0f), 1.0f);
+      break;
+  }
+}
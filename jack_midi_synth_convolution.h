@@ -0,0 +1,85 @@
+#ifndef JACK_MIDI_SYNTH_CONVOLUTION_H
+#define JACK_MIDI_SYNTH_CONVOLUTION_H
+
+#include <atomic>
+#include <vector>
+
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "jack_midi_synth_fft.h"
+#include "jack_midi_synth_filters.h"
+
+// Uniformly partitioned overlap-save convolution with one stretch of an
+// impulse response. Each call takes the next partition of input and
+// returns the same span of output, using a frequency-domain delay line of
+// past input spectra so every partition of the response costs one
+// complex multiply-add per bin. Spectra are held as separate real and
+// imaginary arrays so that loop vectorises.
+class UniformConvolver {
+  private:
+    int partition;
+    int bins;
+    int partitions;
+    int history_index;
+    RealFft fft;
+    std::vector<float> filter_real;
+    std::vector<float> filter_imag;
+    std::vector<float> history_real;
+    std::vector<float> history_imag;
+    std::vector<float> sum_real;
+    std::vector<float> sum_imag;
+    std::vector<std::complex<float> > spectrum;
+    std::vector<float> window;
+    std::vector<float> result;
+  public:
+    UniformConvolver(const float*, int, int);
+    int getPartition() const { return partition; }
+    void process(const float*, float*);
+};
+
+
+// A convolution reverb. The head of the response runs on the calling
+// thread in kHeadPartition frame partitions, and the tail on a background
+// thread in larger partitions, sized to balance the cost of the two. The
+// tail starts two of its own partitions into the response, so the thread
+// has a whole tail partition of time to deliver each one, and process
+// only blocks if it has fallen further behind than that. The wet signal
+// comes out one head partition late and is mixed with the dry signal by
+// the wet level. The response plays at whatever rate the synth runs at.
+class Convolution : public Filter {
+  public:
+    enum Parameters {
+      PARAMETER_WET = 0,
+      kNumParameters
+    };
+    static const int kHeadPartition = 64;
+    static const int kMaxTailPartition = 8192;
+  private:
+    float wet;
+    UniformConvolver head;
+    UniformConvolver* tail;
+    int tail_start;
+    long frames;
+    int fill;
+    std::vector<float> head_input;
+    std::vector<float> head_output;
+    std::vector<float> tail_input[2];
+    std::vector<float> tail_output[2];
+    pthread_t thread;
+    sem_t wake;
+    sem_t done;
+    std::atomic<bool> running;
+    static int getTailPartition(int);
+    static void* static_work(void*);
+    void work();
+    void processPartition();
+  public:
+    Convolution(const std::vector<float>&, float=0.3);
+    ~Convolution();
+    virtual void process(float& value) override { process(&value, 1); }
+    virtual void process(float*, int) override;
+    void setParameter(int, float) override;
+};
+
+#endif // JACK_MIDI_SYNTH_CONVOLUTION_H
@@ -0,0 +1,133 @@
+#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <ctime>
+
+#include <sched.h>
+
+#include "jack_midi_synth_disk_streamer.h"
+
+
+// About 170ms at 48kHz per streaming oscillator, read a quarter at a time.
+const int kStreamFrames = 8192;
+const int kChunkFrames = 2048;
+const long kPollNanoseconds = 5000000;
+
+
+SampleStream::SampleStream(StreamedSample* init_sample) : sample(init_sample), requested_sample(init_sample), filling_sample(init_sample), ring(kStreamFrames), requested(0), ready(0), position(0), starved(false), file_position(0) {
+  DiskStreamer::get().add(this);
+}
+
+SampleStream::~SampleStream() {
+  DiskStreamer::get().remove(this);
+}
+
+float SampleStream::next() {
+  const std::vector<float>& preload = sample->getPreload();
+  if (position < preload.size()) return preload[position++];
+  float value;
+  while (ready.load(std::memory_order_acquire) != requested.load(std::memory_order_relaxed) || !ring.pop(value)) {
+    DiskStreamer& streamer(DiskStreamer::get());
+    if (!streamer.isBlocking()) {
+      if (!starved) DiskStreamer::recordUnderrun();
+      starved = true;
+      return 0.0;
+    }
+    streamer.wake();
+    sched_yield();
+  }
+  starved = false;
+  ++position;
+  return value;
+}
+
+void SampleStream::restart(StreamedSample* new_sample) {
+  sample = new_sample;
+  requested_sample.store(new_sample, std::memory_order_relaxed);
+  requested.fetch_add(1, std::memory_order_release);
+  position = 0;
+  starved = false;
+  DiskStreamer::get().wake();
+}
+
+// Called on the disk thread only. Streams that have never been started are
+// left empty.
+void SampleStream::fill(std::vector<float>& chunk) {
+  int wanted = requested.load(std::memory_order_acquire);
+  if (wanted == 0) return;
+  if (wanted != ready.load(std::memory_order_relaxed)) {
+    filling_sample = requested_sample.load(std::memory_order_relaxed);
+    ring.clear();
+    file_position = filling_sample->getPreload().size();
+    ready.store(wanted, std::memory_order_release);
+  }
+  while (ring.capacity() - ring.size() >= chunk.size() && requested.load(std::memory_order_relaxed) == wanted) {
+    filling_sample->read(file_position, chunk.data(), chunk.size());
+    file_position = (file_position + chunk.size()) % filling_sample->getFrames();
+    for (float value: chunk) ring.push(value);
+  }
+}
+
+
+std::atomic<long> DiskStreamer::underruns(0);
+
+DiskStreamer::DiskStreamer() : running(true), blocking(false) {
+  pthread_mutex_init(&streams_lock, NULL);
+  sem_init(&wake_semaphore, 0, 0);
+  if (pthread_create(&thread, NULL, DiskStreamer::static_work, this)) {
+    std::cerr << "Unable to start disk streaming thread" << std::endl;
+    exit(1);
+  }
+}
+
+DiskStreamer::~DiskStreamer() {
+  running = false;
+  wake();
+  pthread_join(thread, NULL);
+  sem_destroy(&wake_semaphore);
+  pthread_mutex_destroy(&streams_lock);
+}
+
+DiskStreamer& DiskStreamer::get() {
+  static DiskStreamer instance;
+  return instance;
+}
+
+void DiskStreamer::add(SampleStream* stream) {
+  pthread_mutex_lock(&streams_lock);
+  streams.push_back(stream);
+  pthread_mutex_unlock(&streams_lock);
+}
+
+// Waits out any fill in progress, so the stream can be freed as soon as
+// this returns.
+void DiskStreamer::remove(SampleStream* stream) {
+  pthread_mutex_lock(&streams_lock);
+  streams.erase(std::remove(streams.begin(), streams.end(), stream), streams.end());
+  pthread_mutex_unlock(&streams_lock);
+}
+
+void* DiskStreamer::static_work(void* arg) {
+  reinterpret_cast<DiskStreamer*>(arg)->work();
+  return NULL;
+}
+
+void DiskStreamer::work() {
+  std::vector<float> chunk(kChunkFrames);
+  while (running) {
+    timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += kPollNanoseconds;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_nsec -= 1000000000;
+      ++deadline.tv_sec;
+    }
+    while (sem_timedwait(&wake_semaphore, &deadline) == -1 && errno == EINTR);
+    // Several posts may have piled up; one pass serves them all.
+    while (sem_trywait(&wake_semaphore) == 0);
+    pthread_mutex_lock(&streams_lock);
+    for (auto stream: streams) stream->fill(chunk);
+    pthread_mutex_unlock(&streams_lock);
+  }
+}
@@ -0,0 +1,72 @@
+#ifndef JACK_MIDI_SYNTH_DISK_STREAMER_H
+#define JACK_MIDI_SYNTH_DISK_STREAMER_H
+
+#include <atomic>
+#include <vector>
+
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "jack_midi_synth_ring_buffer.h"
+#include "jack_midi_synth_sample.h"
+
+// One voice's way through a StreamedSample. The voice plays the preload
+// straight from memory while the disk thread fills the ring with what
+// follows it. Restarting the note, possibly on another sample, bumps the
+// requested generation; the disk thread then empties the ring, fills it
+// again from the end of that sample's preload and publishes the
+// generation as ready, and the voice only takes from the ring once the
+// two match. Until then, or whenever the ring runs dry, the voice holds
+// its place and plays silence, and each such gap counts as one underrun.
+class SampleStream {
+  private:
+    StreamedSample* sample;
+    std::atomic<StreamedSample*> requested_sample;
+    StreamedSample* filling_sample;
+    RingBuffer<float> ring;
+    std::atomic<int> requested;
+    std::atomic<int> ready;
+    long position;
+    bool starved;
+    long file_position;
+  public:
+    SampleStream(StreamedSample*);
+    ~SampleStream();
+    float next();
+    void restart(StreamedSample*);
+    void fill(std::vector<float>&);
+};
+
+
+// The background thread that keeps every SampleStream's ring topped up. It
+// wakes when a note restarts a stream and otherwise every few
+// milliseconds, and reads a chunk into each ring with room for one. The
+// memory held for streaming is then the preloads plus one ring per
+// streaming oscillator, however large the files are. Blocking makes a
+// stream that has run dry wait for the disk instead of underrunning, for
+// rendering faster than real time.
+class DiskStreamer {
+  private:
+    DiskStreamer();
+    ~DiskStreamer();
+    std::vector<SampleStream*> streams;
+    pthread_mutex_t streams_lock;
+    pthread_t thread;
+    sem_t wake_semaphore;
+    std::atomic<bool> running;
+    std::atomic<bool> blocking;
+    static std::atomic<long> underruns;
+    static void* static_work(void*);
+    void work();
+  public:
+    static DiskStreamer& get();
+    void add(SampleStream*);
+    void remove(SampleStream*);
+    void wake() { sem_post(&wake_semaphore); }
+    void setBlocking(bool value) { blocking.store(value, std::memory_order_relaxed); }
+    bool isBlocking() const { return blocking.load(std::memory_order_relaxed); }
+    static void recordUnderrun() { underruns.fetch_add(1, std::memory_order_relaxed); }
+    static long getUnderruns() { return underruns.load(std::memory_order_relaxed); }
+};
+
+#endif // JACK_MIDI_SYNTH_DISK_STREAMER_H
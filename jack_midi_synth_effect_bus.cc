@@ -0,0 +1,48 @@
+#include "jack_midi_synth_effect_bus.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "jack_midi_synth_filters.h"
+#include "jack_midi_synth_patch.h"
+#include "jack_midi_synth_profiler.h"
+
+
+// A bus starts out quiet.
+EffectBus::EffectBus(const Patch& patch) : hold_frames(0), quiet_frames(0) {
+  for (auto& op: patch.getOps()) {
+    if (op.code == PatchOp::OP_EFFECT) effects.push_back(patch.newFilter(op));
+  }
+  setSampleRate(48000);
+  quiet_frames = hold_frames;
+}
+
+EffectBus::~EffectBus() {
+  for (auto effect: effects) delete effect;
+}
+
+// Filters the send in place, mixes it into out and clears it for the next
+// period.
+void EffectBus::process(float* out, int length) {
+  PROFILE_SCOPE(PROFILE_EFFECTS);
+  float* values = send.data();
+  for (auto effect: effects) effect->process(values, length);
+  float peak = 0.0;
+  for (int frame=0; frame < length; ++frame) {
+    out[frame] += values[frame];
+    peak = std::max(peak, std::fabs(values[frame]));
+  }
+  quiet_frames = peak < kQuietLevel ? std::min(quiet_frames + length, hold_frames) : 0;
+  memset(values, 0, length * sizeof(float));
+}
+
+void EffectBus::setSampleRate(int rate) {
+  float hold_seconds = 0.0;
+  for (auto effect: effects) {
+    effect->setSampleRate(rate);
+    hold_seconds = std::max(hold_seconds, kQuietSeconds + effect->getSilentGap());
+  }
+  hold_frames = hold_seconds * rate;
+  quiet_frames = std::min(quiet_frames, hold_frames);
+}
@@ -0,0 +1,36 @@
+#ifndef JACK_MIDI_SYNTH_EFFECT_BUS_H
+#define JACK_MIDI_SYNTH_EFFECT_BUS_H
+
+#include <vector>
+
+class Filter;
+class Patch;
+
+// The effect ops of a patch, run in order once a period over the sum of
+// the sends of that patch's voices and added back into the output. A
+// time-based effect then keeps one buffer for the whole synth instead of
+// one per voice, and its tail carries on after the voices feeding it have
+// gone quiet. The bus counts as ringing until its output has stayed below
+// kQuietLevel for kQuietSeconds plus the longest silent gap of any of its
+// effects, so a delay isn't cut off between echoes. With no effects the
+// send passes straight through and the bus never rings.
+class EffectBus {
+  public:
+    static constexpr float kQuietLevel = 1e-5;
+    static constexpr float kQuietSeconds = 1.0;
+  private:
+    std::vector<Filter*> effects;
+    std::vector<float> send;
+    int hold_frames;
+    int quiet_frames;
+  public:
+    EffectBus(const Patch&);
+    ~EffectBus();
+    float* getSend() { return send.data(); }
+    void process(float*, int);
+    bool isRinging() const { return quiet_frames < hold_frames; }
+    void setSampleRate(int);
+    void setBufferSize(int size) { send.assign(size, 0.0); }
+};
+
+#endif // JACK_MIDI_SYNTH_EFFECT_BUS_H
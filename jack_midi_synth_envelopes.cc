@@ -1,5 +1,13 @@
 #include "jack_midi_synth_envelopes.h"
 
+#include <algorithm>
+#include <cmath>
+
+
+// How far past its end level an exponential segment aims, as a fraction of
+// the distance it travels. Smaller values give a more pronounced curve.
+const float kExponentialRatio = 0.01;
+
 
 void Envelope::pushDown() {
   down = true;
@@ -18,99 +26,125 @@ bool Envelope::isSounding() {
   return sounding;
 }
 
-float linear_interpolate(float x_start, float y_start, float x_end, float y_end, float x) {
-  float x_diff = x_end - x_start;
-  float y_diff = y_end - y_start;
-  if (x_diff > 0) {
-    return y_start + (x - x_start) * y_diff / x_diff;
-  } else {
-    return 0.5 * (y_start + y_end);
-  }
+
+void Constant::render(float* weights, int length) {
+  for (int frame=0; frame < length; ++frame) weights[frame] = sustain;
 }
 
 
-float LADSR::getWeight(float time) {
-  float weight = 0.0;
-  if (sounding) {
-    if        (down && time < delay) {
-      weight = 0.0;
-    } else if (down && time < delay + attack) {
-      weight = linear_interpolate(delay, 0.0, delay + attack, 1.0, time);
-    } else if (down && time < delay + attack + decay) {
-      weight = linear_interpolate(delay + attack, 1.0, delay + attack + decay, sustain, time);
-    } else if (down || (pedal && !in_release)) {
-      weight = sustain;
-    } else {
-      in_release = true;
-      weight = linear_interpolate(up_time, up_weight, up_time + release, 0.0, time);
-      if (weight <= 0.0) sounding = false;
-      return weight;
-    }
+SegmentEnvelope::SegmentEnvelope(float init_start_level, bool init_sustains, float release_level, float release_time, Shape release_shape) : start_level(init_start_level), sustains(init_sustains), release(release_level, release_time, release_shape), stage(STAGE_IDLE), segment(0), remaining(0), level(init_start_level) {}
+
+void SegmentEnvelope::addSegment(float segment_level, float segment_time, Shape shape) {
+  chain.push_back(Segment(segment_level, segment_time, shape));
+  setSampleRate(sample_rate);
+}
+
+void SegmentEnvelope::prepare(Segment& this_segment, float from) {
+  this_segment.frames = std::max(0, static_cast<int>(this_segment.time * sample_rate + 0.5));
+  if (this_segment.frames == 0) return;
+  if (this_segment.shape == SHAPE_EXPONENTIAL && this_segment.level != from) {
+    float target = this_segment.level + (this_segment.level - from) * kExponentialRatio;
+    this_segment.multiplier = exp(log(kExponentialRatio / (1.0 + kExponentialRatio)) / this_segment.frames);
+    this_segment.increment = target * (1.0 - this_segment.multiplier);
+  } else {
+    this_segment.multiplier = 1.0;
+    this_segment.increment = (this_segment.level - from) / this_segment.frames;
   }
-  up_time = time;
-  up_weight = weight;
-  return weight;
 }
 
+void SegmentEnvelope::setSampleRate(int rate) {
+  Envelope::setSampleRate(rate);
+  float from = start_level;
+  for (auto& this_segment: chain) {
+    prepare(this_segment, from);
+    from = this_segment.level;
+  }
+}
 
-void LADSR::pushDown() {
+void SegmentEnvelope::pushDown() {
   Envelope::pushDown();
-  in_release = false;
+  level = start_level;
+  enterChain(0);
 }
 
+void SegmentEnvelope::enterChain(int index) {
+  while (index < chain.size() && chain[index].frames == 0) level = chain[index++].level;
+  if (index < chain.size()) {
+    stage = STAGE_CHAIN;
+    segment = index;
+    remaining = chain[index].frames;
+  } else if (sustains) {
+    stage = STAGE_SUSTAIN;
+  } else {
+    enterRelease();
+  }
+}
 
-float LAD::getWeight(float time) {
-  float weight = 0.0;
-  if (sounding) {
-    if        (down && time < delay) {
-      weight = 0.0;
-    } else if (down && time < delay + attack) {
-      weight = linear_interpolate(delay, 0.0, delay + attack, 1.0, time);
-    } else {
-      weight = linear_interpolate(up_time, up_weight, up_time + decay, 0.0, time);
-      if (weight <= 0.0) sounding = false;
-      return weight;
-    }
+void SegmentEnvelope::enterRelease() {
+  prepare(release, level);
+  stage = STAGE_RELEASE;
+  remaining = release.frames;
+  if (remaining == 0) {
+    level = release.level;
+    stage = STAGE_IDLE;
+    if (level <= 0.0) sounding = false;
   }
-  up_time = time;
-  up_weight = weight;
-  return weight;
-}
-
-
-DL4R4::DL4R4(float L1, float R1, float L2, float R2, float L3, float R3, float L4, float R4, float init_delay) : L{L1, L2, L3, L4}, R{R1, R2, R3, R4}, delay(init_delay), in_release(false) {
-  if (L4 > 0.0) sounding = true;
-  else sounding = false;
-}
-
-float DL4R4::getWeight(float time) {
-  float weight = 0.0;
-  if (sounding) {
-    if (down && time < delay) {
-      weight = L[3];
-    } else if (down && time < delay + R[0]) {
-      weight = linear_interpolate(delay, L[3], delay + R[0], L[0], time);
-    } else if (down && time < delay + R[0] + R[1]) {
-      weight = linear_interpolate(delay + R[0], L[0], delay + R[0] + R[1], L[1], time);
-    } else if (down && time < delay + R[0] + R[1] + R[2]) {
-      weight = linear_interpolate(delay + R[0] + R[1], L[1], delay + R[0] + R[1] + R[2], L[2], time);
-    } else if (down || (pedal && !in_release)) {
-      weight = L[2];
-    } else {
-      weight = linear_interpolate(up_time, up_weight, up_time + R[3], L[3], time);
-      if (weight <= L[3]) weight = L[3];
-      if (weight <= 0.0) sounding = false;
-      return weight;
+}
+
+bool SegmentEnvelope::isReleased() const {
+  return !down && !pedal;
+}
+
+void SegmentEnvelope::render(float* weights, int length) {
+  int frame = 0;
+  while (frame < length) {
+    if ((stage == STAGE_CHAIN || stage == STAGE_SUSTAIN) && isReleased()) enterRelease();
+    if (stage == STAGE_IDLE || stage == STAGE_SUSTAIN) {
+      for (; frame < length; ++frame) weights[frame] = level;
+      return;
+    }
+    const Segment& current = stage == STAGE_CHAIN ? chain[segment] : release;
+    int frames = std::min(remaining, length - frame);
+    float multiplier = current.multiplier;
+    float increment = current.increment;
+    float running_level = level;
+    for (int i=0; i < frames; ++i) {
+      running_level = running_level * multiplier + increment;
+      weights[frame + i] = running_level;
+    }
+    frame += frames;
+    level = running_level;
+    remaining -= frames;
+    if (remaining == 0) {
+      level = current.level;
+      if (stage == STAGE_CHAIN) {
+        enterChain(segment + 1);
+      } else {
+        stage = STAGE_IDLE;
+        if (level <= 0.0) sounding = false;
+      }
     }
   }
-  up_time = time;
-  up_weight = weight;
-  return weight;
 }
 
 
-void DL4R4::pushDown() {
-  in_release = false;
-  down = true;
-  sounding = true;
+LAD::LAD(float init_attack, float init_decay, float init_delay, Shape shape) : SegmentEnvelope(0.0, false, 0.0, init_decay, shape) {
+  addSegment(0.0, init_delay);
+  addSegment(1.0, init_attack);
+}
+
+
+LADSR::LADSR(float init_attack, float init_decay, float init_sustain, float init_release, float init_delay, Shape shape) : SegmentEnvelope(0.0, true, 0.0, init_release, shape) {
+  addSegment(0.0, init_delay);
+  addSegment(1.0, init_attack);
+  addSegment(init_sustain, init_decay, shape);
+}
+
+
+DL4R4::DL4R4(float L1, float R1, float L2, float R2, float L3, float R3, float L4, float R4, float init_delay, Shape shape) : SegmentEnvelope(L4, true, L4, R4, shape) {
+  addSegment(L4, init_delay);
+  addSegment(L1, R1, shape);
+  addSegment(L2, R2, shape);
+  addSegment(L3, R3, shape);
+  sounding = L4 > 0.0;
 }
@@ -1,21 +1,25 @@
 #ifndef JACK_MIDI_SYNTH_ENVELOPES_H
 #define JACK_MIDI_SYNTH_ENVELOPES_H
 
+#include <vector>
+
 
 class Envelope {
   protected:
     bool down;
     bool sounding;
     bool pedal;
-    float up_time;
-    float up_weight;
+    int sample_rate;
   public:
-    Envelope() : down(false), sounding(false), pedal(false), up_time(0.0), up_weight(0.0) {}
+    Envelope() : down(false), sounding(false), pedal(false), sample_rate(48000) {}
+    virtual ~Envelope() {}
     virtual void pushDown();
     void liftUp();
     void setPedal(bool);
     bool isSounding();
-    virtual float getWeight(float) = 0;
+    virtual void setSampleRate(int new_sample_rate) { sample_rate = new_sample_rate; }
+    virtual float getLevel() const = 0;
+    virtual void render(float*, int) = 0;
 };
 
 
@@ -24,45 +28,78 @@ class Constant : public Envelope {
     float sustain;
   public:
     Constant(float init_sustain) : sustain(init_sustain) {}
-    virtual float getWeight(float time) { return sustain; }
+    virtual float getLevel() const override { return sustain; }
+    virtual void render(float*, int) override;
 };
 
-class LAD : public Envelope {
+
+// Runs a chain of segments from start_level on pushDown, optionally holds the
+// last level while the key (or pedal) is down, then runs a release segment
+// from wherever it got to. Every segment is advanced as
+// level = level * multiplier + increment, so linear and exponential segments
+// cost the same per sample; the coefficients for the chain are worked out
+// when the sample rate is set and the release ones when the key is lifted.
+class SegmentEnvelope : public Envelope {
+  friend class SoaEngine;
+  public:
+    enum Shape {
+      SHAPE_LINEAR = 0,
+      SHAPE_EXPONENTIAL,
+      kNumShapes
+    };
   protected:
-    float attack;
-    float decay;
-    float delay;
+    struct Segment {
+      Segment(float init_level, float init_time, Shape init_shape) : level(init_level), time(init_time), shape(init_shape), frames(0), multiplier(1.0), increment(0.0) {}
+      float level;
+      float time;
+      Shape shape;
+      int frames;
+      float multiplier;
+      float increment;
+    };
+    enum Stage {
+      STAGE_IDLE = 0,
+      STAGE_CHAIN,
+      STAGE_SUSTAIN,
+      STAGE_RELEASE
+    };
+    float start_level;
+    std::vector<Segment> chain;
+    bool sustains;
+    Segment release;
+    Stage stage;
+    int segment;
+    int remaining;
+    float level;
+    void prepare(Segment&, float);
+    void enterChain(int);
+    void enterRelease();
+    bool isReleased() const;
   public:
-    LAD(float init_attack, float init_decay, float init_delay=0.0) : attack(init_attack), decay(init_decay), delay(init_delay) {}
-    virtual float getWeight(float) override;
+    SegmentEnvelope(float init_start_level, bool init_sustains, float release_level, float release_time, Shape release_shape);
+    void addSegment(float, float, Shape=SHAPE_LINEAR);
+    virtual void pushDown() override;
+    virtual void setSampleRate(int) override;
+    virtual float getLevel() const override { return level; }
+    virtual void render(float*, int) override;
 };
 
 
-class LADSR : public LAD {
-  private:
-    float sustain;
-    float release;
-    bool in_release;
+class LAD : public SegmentEnvelope {
   public:
-    LADSR(float init_attack, float init_decay, float init_sustain, float init_release, float init_delay=0.0) : LAD(init_attack, init_decay, init_delay), in_release(false), sustain(init_sustain), release(init_release) {
-      sustain = init_sustain;
-      release = init_release;
-    }
-    virtual float getWeight(float) override;
-    virtual void pushDown() override;
+    LAD(float init_attack, float init_decay, float init_delay=0.0, Shape shape=SHAPE_LINEAR);
 };
 
 
-class DL4R4 : public Envelope {
-  private:
-    float L[4];
-    float R[4];
-    float in_release;
-    float delay;
+class LADSR : public SegmentEnvelope {
   public:
-    DL4R4(float, float, float, float, float, float, float, float, float);
-    float getWeight(float) override;
-    virtual void pushDown() override;
+    LADSR(float init_attack, float init_decay, float init_sustain, float init_release, float init_delay=0.0, Shape shape=SHAPE_LINEAR);
+};
+
+
+class DL4R4 : public SegmentEnvelope {
+  public:
+    DL4R4(float, float, float, float, float, float, float, float, float, Shape=SHAPE_LINEAR);
 };
 
 #endif // JACK_MIDI_SYNTH_ENVELOPES_H
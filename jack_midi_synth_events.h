@@ -1,6 +1,9 @@
 #ifndef JACK_MIDI_SYNTH_EVENTS_H
 #define JACK_MIDI_SYNTH_EVENTS_H
 
+#include <algorithm>
+#include <vector>
+
 struct BoolEvent {
   BoolEvent(int init_frame, bool init_event) : frame(init_frame), value(init_event) {}
   int frame;
@@ -14,9 +17,62 @@ struct IntEvent {
 };
 
 struct FloatEvent {
+  FloatEvent() : frame(0), value(0.0) {}
   FloatEvent(int init_frame, float init_event) : frame(init_frame), value(init_event) {}
   int frame;
   float value;
 };
 
+const int kMaxLaneEvents = 256;
+
+// The controller changes of one period, in a preallocated array so the
+// process thread never allocates. The first entry carries the value from
+// the end of the previous period. Once the lane is full a new event
+// replaces the last one, so the final value of a dense sweep is kept.
+class EventLane {
+  private:
+    FloatEvent events[kMaxLaneEvents];
+    int count;
+  public:
+    EventLane(float initial) : count(1) { events[0] = FloatEvent(0, initial); }
+    int size() const { return count; }
+    const FloatEvent& operator[](int index) const { return events[index]; }
+    const FloatEvent& back() const { return events[count - 1]; }
+    void push(int frame, float value) {
+      if (frame < events[count - 1].frame) frame = events[count - 1].frame;
+      if (count < kMaxLaneEvents) ++count;
+      events[count - 1] = FloatEvent(frame, value);
+    }
+    void cycle(int buffer_size) {
+      events[0] = FloatEvent(events[count - 1].frame - buffer_size, events[count - 1].value);
+      count = 1;
+    }
+};
+
+
+// One period of a controller. In a period where it did not move only the
+// single value is stored and isConstant() is set, so consumers can use a
+// scalar instead of reading a buffer. operator[] works either way.
+class ControllerLane {
+  private:
+    std::vector<float> values;
+    bool constant;
+  public:
+    ControllerLane() : values(1, 0.0), constant(true) {}
+    void resize(int size) { values.resize(std::max(size, 1)); }
+    int size() const { return values.size(); }
+    bool isConstant() const { return constant; }
+    float getValue() const { return values[0]; }
+    float operator[](int frame) const { return constant ? values[0] : values[frame]; }
+    const float* data() const { return values.data(); }
+    void setConstant(float value) {
+      values[0] = value;
+      constant = true;
+    }
+    float* setVarying() {
+      constant = false;
+      return values.data();
+    }
+};
+
 #endif // JACK_MIDI_SYNTH_EVENTS_H
@@ -0,0 +1,64 @@
+#ifndef JACK_MIDI_SYNTH_FAST_MATH_H
+#define JACK_MIDI_SYNTH_FAST_MATH_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+// Cheap replacements for the transcendentals on the audio path. Each is a
+// straight-line inline function with no library calls or data-dependent
+// branches, so a loop over a buffer that calls one vectorises. The bounds
+// below hold over the input ranges the synth feeds them and are checked
+// by jack_midi_synth_fast_math_test.
+
+// fastTanh: absolute error at most kFastTanhMaxError for any input. The
+// [9/8] Lambert continued fraction, clamped to +-1 beyond +-7.
+const float kFastTanhMaxError = 7e-6;
+
+// fastExp2: relative error at most kFastExp2MaxError for inputs in
+// [-126, 126]. Rounds to the nearest integer, which goes straight into the
+// exponent bits, and a degree 6 Taylor polynomial covers the remaining
+// [-0.5, 0.5].
+const float kFastExp2MaxError = 6e-7;
+
+// fastSin2Pi: sin(2 pi offset) for offsets in [0, 1) within
+// kFastSinMaxError. The phase is folded into [-0.25, 0.25] and evaluated
+// with a degree 11 Taylor polynomial.
+const float kFastSinMaxError = 1e-6;
+
+// wrapPhase: the fractional part of a phase in [0, 2^23), exactly as fmod
+// would give it.
+
+inline float fastTanh(float x) {
+  x = std::min(std::max(x, -7.0f), 7.0f);
+  float x2 = x * x;
+  float numerator = x * (34459425.0f + x2 * (4729725.0f + x2 * (135135.0f + x2 * (990.0f + x2))));
+  float denominator = 34459425.0f + x2 * (16216200.0f + x2 * (945945.0f + x2 * (13860.0f + x2 * 45.0f)));
+  return std::min(std::max(numerator / denominator, -1.0f), 1.0f);
+}
+
+inline float fastExp2(float x) {
+  // Adding and subtracting 1.5 * 2^23 rounds to the nearest integer.
+  float whole = (x + 12582912.0f) - 12582912.0f;
+  float f = x - whole;
+  float fraction = 1.0f + f * (0.693147182f + f * (0.240226507f + f * (0.0555041087f + f * (0.00961812911f + f * (0.00133335581f + f * 0.000154035304f)))));
+  int32_t bits = (static_cast<int32_t>(whole) + 127) << 23;
+  float scale;
+  memcpy(&scale, &bits, sizeof(scale));
+  return fraction * scale;
+}
+
+inline float wrapPhase(float offset) {
+  return offset - static_cast<float>(static_cast<int32_t>(offset));
+}
+
+inline float fastSin2Pi(float offset) {
+  float x = 0.5f - offset;
+  x = std::min(x, 0.5f - x);
+  x = std::max(x, -0.5f - x);
+  float y = x * 6.2831853f;
+  float y2 = y * y;
+  return y * (1.0f - y2 / 6.0f * (1.0f - y2 / 20.0f * (1.0f - y2 / 42.0f * (1.0f - y2 / 72.0f * (1.0f - y2 / 110.0f)))));
+}
+
+#endif // JACK_MIDI_SYNTH_FAST_MATH_H
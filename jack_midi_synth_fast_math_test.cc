@@ -0,0 +1,45 @@
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+
+#include "jack_midi_synth_fast_math.h"
+
+// Checks the error bounds documented in jack_midi_synth_fast_math.h, and
+// exits non-zero if any of them no longer holds.
+
+// Sweeps each fast-math function over the inputs the synth gives it (and
+// well past them) against the library version, and reports the worst
+// error next to the bound documented in jack_midi_synth_fast_math.h.
+bool checkAccuracyOf(const char* name, double low, double high, bool relative, float bound, float (*fast)(float), double (*exact)(double)) {
+  const int steps = 10000000;
+  double worst = 0.0;
+  double worst_at = low;
+  for (int i=0; i <= steps; ++i) {
+    float x = low + (high - low) * i / steps;
+    double error = std::fabs(fast(x) - exact(x));
+    if (relative) error /= std::fabs(exact(x));
+    if (error > worst) {
+      worst = error;
+      worst_at = x;
+    }
+  }
+  bool passed = worst <= bound;
+  std::cout << std::defaultfloat << std::setprecision(6) << std::left << std::setw(12) << name << " [" << low << ", " << high << "] " << (relative ? "relative" : "absolute") << " error " << std::scientific << std::setprecision(2) << worst << " at " << std::defaultfloat << std::setprecision(6) << worst_at << ", bound " << bound << (passed ? "" : "  FAILED") << std::endl;
+  return passed;
+}
+
+double exactSin2Pi(double x) { return sin(2.0 * M_PI * x); }
+double exactWrapPhase(double x) { return fmod(x, 1.0); }
+double exactExp2(double x) { return exp2(x); }
+double exactTanh(double x) { return tanh(x); }
+
+int main() {
+  bool passed = true;
+  passed &= checkAccuracyOf("fastTanh", -50.0, 50.0, false, kFastTanhMaxError, fastTanh, exactTanh);
+  passed &= checkAccuracyOf("fastExp2", -126.0, 126.0, true, kFastExp2MaxError, fastExp2, exactExp2);
+  passed &= checkAccuracyOf("fastExp2", -1.0, 1.0, true, kFastExp2MaxError, fastExp2, exactExp2);
+  passed &= checkAccuracyOf("fastSin2Pi", 0.0, 0.99999994, false, kFastSinMaxError, fastSin2Pi, exactSin2Pi);
+  passed &= checkAccuracyOf("wrapPhase", 0.0, 64.0, false, 0.0, wrapPhase, exactWrapPhase);
+  return passed ? 0 : 1;
+}
+
@@ -0,0 +1,82 @@
+#include "jack_midi_synth_fft.h"
+
+#include <cmath>
+
+
+// std::complex's operator* checks for infinities and NaNs through a
+// library call unless the whole program is built with -ffast-math.
+inline std::complex<float> multiply(std::complex<float> a, std::complex<float> b) {
+  return std::complex<float>(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+}
+
+RealFft::RealFft(int init_size) : size(init_size), twiddles(init_size / 4), split_twiddles(init_size / 2), bit_reverse(init_size / 2), scratch(init_size / 2) {
+  int half = size / 2;
+  for (int i=0; i < half / 2; ++i) twiddles[i] = std::polar(1.0, -2.0 * M_PI * i / half);
+  for (int i=0; i < half; ++i) split_twiddles[i] = std::polar(1.0, -2.0 * M_PI * i / size);
+  int bits = 0;
+  while ((1 << bits) < half) ++bits;
+  for (int i=0; i < half; ++i) {
+    int reversed = 0;
+    for (int bit=0; bit < bits; ++bit) reversed |= ((i >> bit) & 1) << (bits - 1 - bit);
+    bit_reverse[i] = reversed;
+  }
+}
+
+// An in-place radix-2 transform of size / 2 points. The inverse is left
+// unscaled.
+void RealFft::transform(std::complex<float>* values, bool inverse) const {
+  int half = size / 2;
+  for (int i=0; i < half; ++i) {
+    if (i < bit_reverse[i]) std::swap(values[i], values[bit_reverse[i]]);
+  }
+  for (int length=2; length <= half; length *= 2) {
+    int stride = half / length;
+    for (int start=0; start < half; start += length) {
+      for (int i=0; i < length / 2; ++i) {
+        std::complex<float> twiddle = twiddles[i * stride];
+        if (inverse) twiddle = std::conj(twiddle);
+        std::complex<float> odd = multiply(twiddle, values[start + i + length / 2]);
+        values[start + i + length / 2] = values[start + i] - odd;
+        values[start + i] += odd;
+      }
+    }
+  }
+}
+
+// Writes size / 2 + 1 bins. The even and odd samples go in as the real and
+// imaginary parts, and each bin is rebuilt from the pair of bins k and
+// size / 2 - k of that transform.
+void RealFft::forward(const float* in, std::complex<float>* out) {
+  int half = size / 2;
+  for (int i=0; i < half; ++i) scratch[i] = std::complex<float>(in[2 * i], in[2 * i + 1]);
+  transform(scratch.data(), false);
+  out[0] = std::complex<float>(scratch[0].real() + scratch[0].imag(), 0.0f);
+  out[half] = std::complex<float>(scratch[0].real() - scratch[0].imag(), 0.0f);
+  for (int k=1; k < half; ++k) {
+    std::complex<float> a = scratch[k];
+    std::complex<float> b = std::conj(scratch[half - k]);
+    std::complex<float> even = 0.5f * (a + b);
+    std::complex<float> difference = a - b;
+    std::complex<float> odd(0.5f * difference.imag(), -0.5f * difference.real());
+    out[k] = even + multiply(split_twiddles[k], odd);
+  }
+}
+
+// Takes size / 2 + 1 bins and writes size samples, scaled so that inverse
+// undoes forward.
+void RealFft::inverse(const std::complex<float>* in, float* out) {
+  int half = size / 2;
+  for (int k=0; k < half; ++k) {
+    std::complex<float> a = in[k];
+    std::complex<float> b = std::conj(in[half - k]);
+    std::complex<float> even = 0.5f * (a + b);
+    std::complex<float> odd = multiply(0.5f * (a - b), std::conj(split_twiddles[k]));
+    scratch[k] = even + std::complex<float>(-odd.imag(), odd.real());
+  }
+  transform(scratch.data(), true);
+  float scale = 1.0f / half;
+  for (int i=0; i < half; ++i) {
+    out[2 * i] = scratch[i].real() * scale;
+    out[2 * i + 1] = scratch[i].imag() * scale;
+  }
+}
@@ -0,0 +1,29 @@
+#ifndef JACK_MIDI_SYNTH_FFT_H
+#define JACK_MIDI_SYNTH_FFT_H
+
+#include <complex>
+#include <vector>
+
+// A real FFT of one power-of-two size. The N real samples are packed into
+// an N/2 point complex transform and split afterwards, so a transform
+// costs about half of a complex one. Twiddles, the bit-reversal table and
+// the scratch buffer are all built in the constructor, so forward and
+// inverse never allocate; the scratch buffer makes each RealFft usable
+// from one thread at a time.
+class RealFft {
+  private:
+    int size;
+    std::vector<std::complex<float> > twiddles;
+    std::vector<std::complex<float> > split_twiddles;
+    std::vector<int> bit_reverse;
+    std::vector<std::complex<float> > scratch;
+    void transform(std::complex<float>*, bool) const;
+  public:
+    RealFft(int);
+    int getSize() const { return size; }
+    int getBins() const { return size / 2 + 1; }
+    void forward(const float*, std::complex<float>*);
+    void inverse(const std::complex<float>*, float*);
+};
+
+#endif // JACK_MIDI_SYNTH_FFT_H
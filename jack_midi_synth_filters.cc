@@ -1,5 +1,7 @@
 #include "jack_midi_synth_filters.h"
 
+#include <cmath>
+
 
 void Pass::setParameter(int parameter, float value) {
   if (value < 0.01) value = 0.01;
@@ -16,40 +18,206 @@ void Pass::setParameter(int parameter, float value) {
 
 void Pass::setFilterMode(Pass::FilterMode new_mode) {
   if (new_mode >= 0 && new_mode < kNumFilterModes) mode = new_mode;
-}
-
-void Pass::process(float& value) {
-  buffer[0] += cutoff * (value - buffer[0] + feedbackAmount * (buffer[0] - buffer[1]));
-  for (int i=1; i < buffer.size(); ++i) buffer[i] += cutoff * (buffer[i-1] - buffer[i]);
   switch (mode) {
-    case FILTER_MODE_LOWPASS:
-      value = buffer[buffer.size()-1];
-      break;
     case FILTER_MODE_HIGHPASS:
-      value = value - buffer[buffer.size()-1];
+      block_function = selectBlock<FILTER_MODE_HIGHPASS>();
       break;
     case FILTER_MODE_BANDPASS:
-      value = buffer[0] - buffer[buffer.size()-1];
+      block_function = selectBlock<FILTER_MODE_BANDPASS>();
       break;
     case FILTER_MODE_NOTCH:
-      value = value - buffer[0] + buffer[buffer.size()-1];
+      block_function = selectBlock<FILTER_MODE_NOTCH>();
+      break;
+    default:
+      block_function = selectBlock<FILTER_MODE_LOWPASS>();
+      break;
+  }
+}
+
+// The same arithmetic as process, with the stages held in locals. A first
+// order filter feeds back its only stage against itself, which is no
+// feedback at all.
+template <int Order, Pass::FilterMode Mode>
+void Pass::processBlock(float* values, int length) {
+  float stages[Order];
+  for (int i=0; i < Order; ++i) stages[i] = buffer[i];
+  const float this_cutoff = cutoff;
+  const float this_feedback = feedbackAmount;
+  for (int frame=0; frame < length; ++frame) {
+    float value = values[frame];
+    stages[0] += this_cutoff * (value - stages[0] + this_feedback * (stages[0] - stages[Order > 1 ? 1 : 0]));
+    for (int i=1; i < Order; ++i) stages[i] += this_cutoff * (stages[i-1] - stages[i]);
+    switch (Mode) {
+      case FILTER_MODE_LOWPASS:
+        values[frame] = stages[Order-1];
+        break;
+      case FILTER_MODE_HIGHPASS:
+        values[frame] = value - stages[Order-1];
+        break;
+      case FILTER_MODE_BANDPASS:
+        values[frame] = stages[0] - stages[Order-1];
+        break;
+      case FILTER_MODE_NOTCH:
+        values[frame] = value - stages[0] + stages[Order-1];
+        break;
+    }
+  }
+  for (int i=0; i < Order; ++i) buffer[i] = stages[i];
+}
+
+// Longer filters fall back to the per-sample process.
+template <>
+void Pass::processBlock<0, Pass::FILTER_MODE_LOWPASS>(float* values, int length) {
+  for (int frame=0; frame < length; ++frame) process(values[frame]);
+}
+
+template <Pass::FilterMode Mode>
+Pass::BlockFunction Pass::selectBlock() const {
+  switch (buffer.size()) {
+    case 1: return &Pass::processBlock<1, Mode>;
+    case 2: return &Pass::processBlock<2, Mode>;
+    case 3: return &Pass::processBlock<3, Mode>;
+    case 4: return &Pass::processBlock<4, Mode>;
+    case 5: return &Pass::processBlock<5, Mode>;
+    case 6: return &Pass::processBlock<6, Mode>;
+    case 7: return &Pass::processBlock<7, Mode>;
+    case 8: return &Pass::processBlock<8, Mode>;
+    default: return &Pass::processBlock<0, FILTER_MODE_LOWPASS>;
+  }
+}
+
+StateVariable::StateVariable(Pass::FilterMode init_mode, float init_cutoff, float init_resonance) : Filter("StateVariable"), cutoff(init_cutoff), resonance(init_resonance), mode(init_mode), ic1eq(0.0), ic2eq(0.0), prewarp(kPrewarpSize + 1) {
+  if (mode < 0 || mode >= Pass::kNumFilterModes) mode = Pass::FILTER_MODE_LOWPASS;
+  setSampleRate(sample_rate);
+}
+
+void StateVariable::process(float& value) {
+  switch (mode) {
+    case Pass::FILTER_MODE_HIGHPASS:
+      value = tick<Pass::FILTER_MODE_HIGHPASS>(value, g, k);
+      break;
+    case Pass::FILTER_MODE_BANDPASS:
+      value = tick<Pass::FILTER_MODE_BANDPASS>(value, g, k);
+      break;
+    case Pass::FILTER_MODE_NOTCH:
+      value = tick<Pass::FILTER_MODE_NOTCH>(value, g, k);
+      break;
+    default:
+      value = tick<Pass::FILTER_MODE_LOWPASS>(value, g, k);
+      break;
+  }
+}
+
+void StateVariable::process(float* values, int length) {
+  switch (mode) {
+    case Pass::FILTER_MODE_HIGHPASS:
+      run<Pass::FILTER_MODE_HIGHPASS>(values, length);
+      break;
+    case Pass::FILTER_MODE_BANDPASS:
+      run<Pass::FILTER_MODE_BANDPASS>(values, length);
+      break;
+    case Pass::FILTER_MODE_NOTCH:
+      run<Pass::FILTER_MODE_NOTCH>(values, length);
+      break;
+    default:
+      run<Pass::FILTER_MODE_LOWPASS>(values, length);
+      break;
+  }
+}
+
+template <int Mode>
+void StateVariable::run(float* values, int length) {
+  for (int i=0; i < length; ++i) values[i] = tick<Mode>(values[i], g, k);
+}
+
+template <int Mode>
+void StateVariable::run(float* values, const float* cutoff_offsets, const float* resonance_offsets, int length) {
+  for (int i=0; i < length; ++i) {
+    values[i] = tick<Mode>(values[i], getPrewarp(cutoff + cutoff_offsets[i]), getDamping(resonance + resonance_offsets[i]));
+  }
+}
+
+void StateVariable::processModulated(float* values, const float* cutoff_offsets, const float* resonance_offsets, int length) {
+  switch (mode) {
+    case Pass::FILTER_MODE_HIGHPASS:
+      run<Pass::FILTER_MODE_HIGHPASS>(values, cutoff_offsets, resonance_offsets, length);
+      break;
+    case Pass::FILTER_MODE_BANDPASS:
+      run<Pass::FILTER_MODE_BANDPASS>(values, cutoff_offsets, resonance_offsets, length);
+      break;
+    case Pass::FILTER_MODE_NOTCH:
+      run<Pass::FILTER_MODE_NOTCH>(values, cutoff_offsets, resonance_offsets, length);
+      break;
+    default:
+      run<Pass::FILTER_MODE_LOWPASS>(values, cutoff_offsets, resonance_offsets, length);
+      break;
+  }
+}
+
+void StateVariable::setParameter(int parameter, float value) {
+  value = std::min(std::max(value, 0.0f), 1.0f);
+  switch (parameter) {
+    case PARAMETER_CUTOFF:
+      cutoff = value;
+      g = getPrewarp(cutoff);
+      break;
+    case PARAMETER_RESONANCE:
+      resonance = value;
+      k = getDamping(resonance);
       break;
   }
 }
 
-void Delay::process(float& value) {
-  index %= buffer.size();
-  value += buffer[index] * feedback;
-  buffer[index++] = value;
+// g = tan(pi f / fs) for f = 20 Hz * 1000^position, held just under
+// Nyquist.
+void StateVariable::setSampleRate(int rate) {
+  Filter::setSampleRate(rate);
+  for (int i=0; i <= kPrewarpSize; ++i) {
+    double frequency = std::min(20.0 * pow(1000.0, static_cast<double>(i) / kPrewarpSize), 0.49 * sample_rate);
+    prewarp[i] = tan(M_PI * frequency / sample_rate);
+  }
+  g = getPrewarp(cutoff);
+  k = getDamping(resonance);
+}
+
+// Runs in stretches where neither the read nor the write position wraps,
+// which are plain loops over two pointers.
+void Delay::process(float* values, int length) {
+  int frame = 0;
+  while (frame < length) {
+    int read = (index - delay_frames) & mask;
+    int count = std::min(length - frame, static_cast<int>(buffer.size()) - std::max(index, read));
+    // A delay shorter than the stretch would read what it has just written.
+    count = std::min(count, delay_frames);
+    float* in = buffer.data() + read;
+    float* out = buffer.data() + index;
+    for (int i=0; i < count; ++i) {
+      float value = values[frame + i] + in[i] * feedback;
+      values[frame + i] = value;
+      out[i] = value;
+    }
+    frame += count;
+    index = (index + count) & mask;
+  }
+}
+
+void Delay::resize() {
+  delay_frames = std::max(static_cast<int>(delay * sample_rate), 1);
+  int size = 1;
+  while (size < delay_frames) size *= 2;
+  if (buffer.size() != size) {
+    buffer.assign(size, 0.0);
+    index = 0;
+  }
+  mask = size - 1;
 }
 
 void Delay::setParameter(int parameter, float value) {
   if (value < 0.00005) value = 0.00005;
-  int new_size = static_cast<int>(value * sample_rate);
   switch (parameter) {
     case PARAMETER_DELAY:
       delay = value;
-      if (buffer.size() != new_size) buffer.resize(new_size);
+      resize();
       break;
     case PARAMETER_FEEDBACK:
       if (value > 1.0) value = 1.0;
@@ -60,5 +228,5 @@ void Delay::setParameter(int parameter, float value) {
 
 void Delay::setSampleRate(int rate) {
   Filter::setSampleRate(rate);
-  buffer.resize(sample_rate * delay);
+  resize();
 }
@@ -1,20 +1,37 @@
 #ifndef JACK_MIDI_SYNTH_FILTERS_H
 #define JACK_MIDI_SYNTH_FILTERS_H
 
+#include <algorithm>
 #include <vector>
 
 class Filter {
   protected:
     int sample_rate;
   public:
-    Filter(const char* init_type) : type(init_type) {}
+    Filter(const char* init_type) : sample_rate(48000), type(init_type) {}
+    virtual ~Filter() {}
     virtual void process(float&) = 0;
+    // Filters a whole block in place, so the per-sample loop runs without a
+    // virtual call per sample.
+    virtual void process(float* values, int length) {
+      for (int i=0; i < length; ++i) process(values[i]);
+    }
+    // Runs a block with per-sample offsets added to the filter's own cutoff
+    // and resonance. Filters without those parameters ignore them.
+    virtual void processModulated(float* values, const float*, const float*, int length) {
+      process(values, length);
+    }
     virtual void setParameter(int, float) = 0;
     virtual void setSampleRate(int new_sample_rate) { sample_rate = new_sample_rate; }
+    // The longest the filter can stay silent while it still holds signal
+    // it will play later, in seconds.
+    virtual float getSilentGap() const { return 0.0; }
     const char* type;
 };
 
 
+// The block process runs a kernel with the order and mode fixed at compile
+// time, chosen when the mode is set, for orders up to kMaxBlockOrder.
 class Pass : public Filter {
   public:
     enum FilterMode {
@@ -36,14 +53,46 @@ class Pass : public Filter {
     float feedbackAmount;
     inline void calculateFeedbackAmount() { feedbackAmount = resonance + resonance/(1.0 - cutoff); }
     std::vector<float> buffer;
+    typedef void (Pass::*BlockFunction)(float*, int);
+    BlockFunction block_function;
+    template <int Order, FilterMode Mode>
+    void processBlock(float*, int);
+    template <FilterMode Mode>
+    BlockFunction selectBlock() const;
   public:
-    Pass(FilterMode filter=FILTER_MODE_LOWPASS, int init_order=2) : mode(kNumFilterModes), buffer(init_order, 0.0), Filter("Pass") {
+    static const int kMaxBlockOrder = 8;
+    Pass(FilterMode filter=FILTER_MODE_LOWPASS, int init_order=2) : mode(kNumFilterModes), buffer(init_order, 0.0), block_function(nullptr), Filter("Pass") {
       setFilterMode(filter);
       setCutoff(0.99);
       setResonance(0.01);
       calculateFeedbackAmount();
     }
-    virtual void process(float&) override;
+    virtual void process(float& value) override {
+      buffer[0] += cutoff * (value - buffer[0] + feedbackAmount * (buffer[0] - buffer[buffer.size() > 1 ? 1 : 0]));
+      for (int i=1; i < buffer.size(); ++i) buffer[i] += cutoff * (buffer[i-1] - buffer[i]);
+      switch (mode) {
+        case FILTER_MODE_LOWPASS:
+          value = buffer[buffer.size()-1];
+          break;
+        case FILTER_MODE_HIGHPASS:
+          value = value - buffer[buffer.size()-1];
+          break;
+        case FILTER_MODE_BANDPASS:
+          value = buffer[0] - buffer[buffer.size()-1];
+          break;
+        case FILTER_MODE_NOTCH:
+          value = value - buffer[0] + buffer[buffer.size()-1];
+          break;
+      }
+    }
+    virtual void process(float* values, int length) override { (this->*block_function)(values, length); }
+    // Pass only updates its coefficients once a block, from the offsets
+    // halfway through it.
+    virtual void processModulated(float* values, const float* cutoff_offsets, const float* resonance_offsets, int length) override {
+      setParameter(PARAMETER_CUTOFF, 1.0f + cutoff_offsets[length / 2]);
+      setParameter(PARAMETER_RESONANCE, resonance_offsets[length / 2]);
+      process(values, length);
+    }
     void setCutoff(float new_cutoff) { cutoff = new_cutoff; calculateFeedbackAmount(); }
     void setResonance(float new_resonance) { resonance = new_resonance; calculateFeedbackAmount(); }
     void setParameter(int, float) override;
@@ -51,6 +100,68 @@ class Pass : public Filter {
 };
 
 
+// A zero-delay-feedback state-variable filter (the trapezoidal SVF from
+// Zavalishin's "The Art of VA Filter Design"). Cutoff runs from 0 to 1 on
+// an exponential 20 Hz to 20 kHz scale and resonance from 0 to 1, just
+// short of self-oscillation. The tan prewarp for the whole cutoff range is
+// tabulated when the sample rate is set, so moving the cutoff every
+// sample costs a table lerp and one divide rather than a tan.
+class StateVariable : public Filter {
+  public:
+    enum Parameters {
+      PARAMETER_CUTOFF = 0,
+      PARAMETER_RESONANCE,
+      kNumParameters
+    };
+  private:
+    static const int kPrewarpSize = 256;
+    float cutoff;
+    float resonance;
+    Pass::FilterMode mode;
+    float g;
+    float k;
+    float ic1eq;
+    float ic2eq;
+    std::vector<float> prewarp;
+    float getPrewarp(float position) const {
+      position = std::min(std::max(position, 0.0f), 1.0f) * kPrewarpSize;
+      int index = std::min(static_cast<int>(position), kPrewarpSize - 1);
+      return prewarp[index] + (position - index) * (prewarp[index + 1] - prewarp[index]);
+    }
+    static float getDamping(float position) { return 2.0f - 1.98f * std::min(std::max(position, 0.0f), 1.0f); }
+    template <int Mode>
+    float tick(float value, float this_g, float this_k) {
+      float a1 = 1.0f / (1.0f + this_g * (this_g + this_k));
+      float v3 = value - ic2eq;
+      float v1 = a1 * ic1eq + this_g * a1 * v3;
+      float v2 = ic2eq + this_g * v1;
+      ic1eq = 2.0f * v1 - ic1eq;
+      ic2eq = 2.0f * v2 - ic2eq;
+      switch (Mode) {
+        case Pass::FILTER_MODE_HIGHPASS:
+          return value - this_k * v1 - v2;
+        case Pass::FILTER_MODE_BANDPASS:
+          return v1;
+        case Pass::FILTER_MODE_NOTCH:
+          return value - this_k * v1;
+        default:
+          return v2;
+      }
+    }
+    template <int Mode>
+    void run(float*, int);
+    template <int Mode>
+    void run(float*, const float*, const float*, int);
+  public:
+    StateVariable(Pass::FilterMode=Pass::FILTER_MODE_LOWPASS, float=0.5, float=0.0);
+    virtual void process(float&) override;
+    virtual void process(float*, int) override;
+    virtual void processModulated(float*, const float*, const float*, int) override;
+    void setParameter(int, float) override;
+    void setSampleRate(int) override;
+};
+
+
 class Delay : public Filter {
   public:
     enum Parameters {
@@ -61,13 +172,26 @@ class Delay : public Filter {
   private:
     float delay;
     float feedback;
+    // A power-of-two ring at least delay_frames long, so wrapping is a mask
+    // rather than a modulo.
     std::vector<float> buffer;
+    int mask;
+    int delay_frames;
     int index;
+    void resize();
   public:
-    Delay(float init_delay=0.3, float init_feedback=0.6) : delay(init_delay), feedback(init_feedback), index(0), Filter("Delay") { }
-    virtual void process(float&) override;
+    Delay(float init_delay=0.3, float init_feedback=0.6) : delay(init_delay), feedback(init_feedback), mask(0), delay_frames(1), index(0), Filter("Delay") {
+      resize();
+    }
+    virtual void process(float& value) override {
+      value += buffer[(index - delay_frames) & mask] * feedback;
+      buffer[index] = value;
+      index = (index + 1) & mask;
+    }
+    virtual void process(float*, int) override;
     void setParameter(int, float) override;
     void setSampleRate(int) override;
+    virtual float getSilentGap() const override { return delay; }
 };
 
 #endif // JACK_MIDI_SYNTH_FILTERS_H
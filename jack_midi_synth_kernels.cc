@@ -0,0 +1,354 @@
+#include "jack_midi_synth_kernels.h"
+#include "jack_midi_synth_fast_math.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#if defined(__AVX__)
+typedef __m256 vfloat;
+const int kLanes = 8;
+inline vfloat vset(float value) { return _mm256_set1_ps(value); }
+inline vfloat vload(const float* source) { return _mm256_loadu_ps(source); }
+inline void vstore(float* destination, vfloat value) { _mm256_storeu_ps(destination, value); }
+inline vfloat vadd(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+inline vfloat vsub(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+inline vfloat vmul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+inline vfloat vmin(vfloat a, vfloat b) { return _mm256_min_ps(a, b); }
+inline vfloat vmax(vfloat a, vfloat b) { return _mm256_max_ps(a, b); }
+inline vfloat vless(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+inline vfloat vselect(vfloat mask, vfloat a, vfloat b) { return _mm256_blendv_ps(b, a, mask); }
+inline float vsum(vfloat value) {
+  __m128 sum = _mm_add_ps(_mm256_castps256_ps128(value), _mm256_extractf128_ps(value, 1));
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  return _mm_cvtss_f32(_mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1)));
+}
+#define JACK_MIDI_SYNTH_VECTOR_KERNELS
+#elif defined(__SSE2__)
+typedef __m128 vfloat;
+const int kLanes = 4;
+inline vfloat vset(float value) { return _mm_set1_ps(value); }
+inline vfloat vload(const float* source) { return _mm_loadu_ps(source); }
+inline void vstore(float* destination, vfloat value) { _mm_storeu_ps(destination, value); }
+inline vfloat vadd(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+inline vfloat vsub(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+inline vfloat vmul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+inline vfloat vmin(vfloat a, vfloat b) { return _mm_min_ps(a, b); }
+inline vfloat vmax(vfloat a, vfloat b) { return _mm_max_ps(a, b); }
+inline vfloat vless(vfloat a, vfloat b) { return _mm_cmplt_ps(a, b); }
+inline vfloat vselect(vfloat mask, vfloat a, vfloat b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+inline float vsum(vfloat value) {
+  __m128 sum = _mm_add_ps(value, _mm_movehl_ps(value, value));
+  return _mm_cvtss_f32(_mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1)));
+}
+#define JACK_MIDI_SYNTH_VECTOR_KERNELS
+#endif
+
+
+// Maps an offset in [0, 1) so that pulse_centre lands on 0.5, matching
+// PitchedOscillator::pulseWidthModulate.
+void kernelPulseWidthModulate(float* offsets, float pulse_centre, int length) {
+  float below = 0.5 / pulse_centre;
+  float above = 0.5 / (1.0 - pulse_centre);
+  int i = 0;
+#ifdef JACK_MIDI_SYNTH_VECTOR_KERNELS
+  vfloat centre = vset(pulse_centre);
+  vfloat half = vset(0.5);
+  vfloat below_scale = vset(below);
+  vfloat above_scale = vset(above);
+  for (; i + kLanes <= length; i += kLanes) {
+    vfloat offset = vload(offsets + i);
+    vfloat low = vmul(offset, below_scale);
+    vfloat high = vadd(half, vmul(vsub(offset, centre), above_scale));
+    vstore(offsets + i, vselect(vless(offset, centre), low, high));
+  }
+#endif
+  for (; i < length; ++i) {
+    if (offsets[i] < pulse_centre) offsets[i] = offsets[i] * below;
+    else offsets[i] = 0.5 + (offsets[i] - pulse_centre) * above;
+  }
+}
+
+
+// sin(2 pi offset) for offset in [0, 1), as fastSin2Pi with the multiplies
+// spelled out for the vector body.
+void kernelSine(const float* offsets, float* out, int length) {
+  int i = 0;
+#ifdef JACK_MIDI_SYNTH_VECTOR_KERNELS
+  vfloat one = vset(1.0);
+  vfloat half = vset(0.5);
+  vfloat negative_half = vset(-0.5);
+  vfloat two_pi = vset(6.2831853);
+  vfloat c3 = vset(1.0 / 6.0);
+  vfloat c5 = vset(1.0 / 20.0);
+  vfloat c7 = vset(1.0 / 42.0);
+  vfloat c9 = vset(1.0 / 72.0);
+  vfloat c11 = vset(1.0 / 110.0);
+  for (; i + kLanes <= length; i += kLanes) {
+    vfloat x = vsub(half, vload(offsets + i));
+    x = vmin(x, vsub(half, x));
+    x = vmax(x, vsub(negative_half, x));
+    vfloat y = vmul(x, two_pi);
+    vfloat y2 = vmul(y, y);
+    vfloat poly = vsub(one, vmul(y2, c11));
+    poly = vsub(one, vmul(vmul(y2, c9), poly));
+    poly = vsub(one, vmul(vmul(y2, c7), poly));
+    poly = vsub(one, vmul(vmul(y2, c5), poly));
+    poly = vsub(one, vmul(vmul(y2, c3), poly));
+    vstore(out + i, vmul(y, poly));
+  }
+#endif
+  for (; i < length; ++i) out[i] = fastSin2Pi(offsets[i]);
+}
+
+
+void kernelPulse(const float* offsets, float* out, int length) {
+  int i = 0;
+#ifdef JACK_MIDI_SYNTH_VECTOR_KERNELS
+  vfloat half = vset(0.5);
+  vfloat low = vset(-1.0);
+  vfloat high = vset(1.0);
+  for (; i + kLanes <= length; i += kLanes) {
+    vstore(out + i, vselect(vless(vload(offsets + i), half), low, high));
+  }
+#endif
+  for (; i < length; ++i) out[i] = offsets[i] < 0.5 ? -1.0 : 1.0;
+}
+
+
+void kernelTriangle(const float* offsets, float* out, int length) {
+  int i = 0;
+#ifdef JACK_MIDI_SYNTH_VECTOR_KERNELS
+  vfloat one = vset(1.0);
+  vfloat three = vset(3.0);
+  vfloat four = vset(4.0);
+  for (; i + kLanes <= length; i += kLanes) {
+    vfloat scaled = vmul(four, vload(offsets + i));
+    vstore(out + i, vmin(vsub(scaled, one), vsub(three, scaled)));
+  }
+#endif
+  for (; i < length; ++i) {
+    out[i] = offsets[i] < 0.5 ? (4.0 * offsets[i] - 1.0) : (3.0 - (4.0 * offsets[i]));
+  }
+}
+
+
+void kernelSaw(const float* offsets, float* out, int length) {
+  int i = 0;
+#ifdef JACK_MIDI_SYNTH_VECTOR_KERNELS
+  vfloat one = vset(1.0);
+  vfloat two = vset(2.0);
+  for (; i + kLanes <= length; i += kLanes) {
+    vstore(out + i, vsub(vmul(two, vload(offsets + i)), one));
+  }
+#endif
+  for (; i < length; ++i) out[i] = (2.0 * offsets[i]) - 1.0;
+}
+
+
+void kernelReverseSaw(const float* offsets, float* out, int length) {
+  int i = 0;
+#ifdef JACK_MIDI_SYNTH_VECTOR_KERNELS
+  vfloat one = vset(1.0);
+  vfloat two = vset(2.0);
+  for (; i + kLanes <= length; i += kLanes) {
+    vstore(out + i, vsub(one, vmul(two, vload(offsets + i))));
+  }
+#endif
+  for (; i < length; ++i) out[i] = 1.0 - (2.0 * offsets[i]);
+}
+
+
+// kNoiseLanes independent xorshift32 generators, interleaved so that
+// out[i] comes from lane i % kNoiseLanes. The top 23 bits of each state are
+// dropped into the mantissa of a float in [2, 4) and shifted down to [-1, 1).
+inline float noiseScalar(uint32_t& state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  uint32_t bits = (state >> 9) | 0x40000000;
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value - 3.0;
+}
+
+void kernelNoise(uint32_t* states, float* out, int length) {
+  int i = 0;
+#ifdef JACK_MIDI_SYNTH_VECTOR_KERNELS
+  __m128i mantissa_exponent = _mm_set1_epi32(0x40000000);
+  __m128 three = _mm_set1_ps(3.0);
+  __m128i low_states = _mm_loadu_si128(reinterpret_cast<const __m128i*>(states));
+  __m128i high_states = _mm_loadu_si128(reinterpret_cast<const __m128i*>(states + 4));
+  for (; i + kNoiseLanes <= length; i += kNoiseLanes) {
+    low_states = _mm_xor_si128(low_states, _mm_slli_epi32(low_states, 13));
+    high_states = _mm_xor_si128(high_states, _mm_slli_epi32(high_states, 13));
+    low_states = _mm_xor_si128(low_states, _mm_srli_epi32(low_states, 17));
+    high_states = _mm_xor_si128(high_states, _mm_srli_epi32(high_states, 17));
+    low_states = _mm_xor_si128(low_states, _mm_slli_epi32(low_states, 5));
+    high_states = _mm_xor_si128(high_states, _mm_slli_epi32(high_states, 5));
+    __m128 low = _mm_castsi128_ps(_mm_or_si128(_mm_srli_epi32(low_states, 9), mantissa_exponent));
+    __m128 high = _mm_castsi128_ps(_mm_or_si128(_mm_srli_epi32(high_states, 9), mantissa_exponent));
+    _mm_storeu_ps(out + i, _mm_sub_ps(low, three));
+    _mm_storeu_ps(out + i + 4, _mm_sub_ps(high, three));
+  }
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(states), low_states);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(states + 4), high_states);
+#endif
+  for (; i < length; ++i) out[i] = noiseScalar(states[i % kNoiseLanes]);
+}
+
+
+// Reads a table of size samples (plus one guard sample) at offsets in
+// [0, 1), interpolating linearly between neighbouring samples. With AVX2
+// the two neighbours are fetched with gathers.
+void kernelWavetable(const float* table, int size, const float* offsets, float* out, int length) {
+  int i = 0;
+#if defined(__AVX2__)
+  __m256 scale = _mm256_set1_ps(size);
+  __m256i last = _mm256_set1_epi32(size - 1);
+  __m256i one = _mm256_set1_epi32(1);
+  for (; i + 8 <= length; i += 8) {
+    __m256 position = _mm256_mul_ps(_mm256_loadu_ps(offsets + i), scale);
+    __m256i index = _mm256_min_epi32(_mm256_cvttps_epi32(position), last);
+    __m256 fraction = _mm256_sub_ps(position, _mm256_cvtepi32_ps(index));
+    __m256 here = _mm256_i32gather_ps(table, index, 4);
+    __m256 next = _mm256_i32gather_ps(table, _mm256_add_epi32(index, one), 4);
+    _mm256_storeu_ps(out + i, _mm256_add_ps(here, _mm256_mul_ps(fraction, _mm256_sub_ps(next, here))));
+  }
+#endif
+  for (; i < length; ++i) {
+    float position = offsets[i] * size;
+    int index = std::min(static_cast<int>(position), size - 1);
+    float fraction = position - index;
+    out[i] = table[index] + fraction * (table[index + 1] - table[index]);
+  }
+}
+
+
+// Source positions are relative to source, whose whole parts are at least
+// kResampleTapsBefore, as for all three resampling kernels.
+void kernelResampleLinear(const float* source, const float* positions, float* out, int length, float) {
+  int i = 0;
+#if defined(__AVX2__)
+  __m256i one = _mm256_set1_epi32(1);
+  for (; i + 8 <= length; i += 8) {
+    __m256 position = _mm256_loadu_ps(positions + i);
+    __m256i index = _mm256_cvttps_epi32(position);
+    __m256 fraction = _mm256_sub_ps(position, _mm256_cvtepi32_ps(index));
+    __m256 here = _mm256_i32gather_ps(source, index, 4);
+    __m256 next = _mm256_i32gather_ps(source, _mm256_add_epi32(index, one), 4);
+    _mm256_storeu_ps(out + i, _mm256_add_ps(here, _mm256_mul_ps(fraction, _mm256_sub_ps(next, here))));
+  }
+#endif
+  for (; i < length; ++i) {
+    int index = static_cast<int>(positions[i]);
+    float fraction = positions[i] - index;
+    out[i] = source[index] + fraction * (source[index + 1] - source[index]);
+  }
+}
+
+
+// Catmull-Rom through the two frames either side of each position.
+void kernelResampleCubic(const float* source, const float* positions, float* out, int length, float) {
+  int i = 0;
+#if defined(__AVX2__)
+  __m256i one = _mm256_set1_epi32(1);
+  __m256 half = _mm256_set1_ps(0.5);
+  __m256 two = _mm256_set1_ps(2.0);
+  __m256 three = _mm256_set1_ps(3.0);
+  __m256 four = _mm256_set1_ps(4.0);
+  __m256 five = _mm256_set1_ps(5.0);
+  for (; i + 8 <= length; i += 8) {
+    __m256 position = _mm256_loadu_ps(positions + i);
+    __m256i index = _mm256_cvttps_epi32(position);
+    __m256 f = _mm256_sub_ps(position, _mm256_cvtepi32_ps(index));
+    __m256 p0 = _mm256_i32gather_ps(source, _mm256_sub_epi32(index, one), 4);
+    __m256 p1 = _mm256_i32gather_ps(source, index, 4);
+    __m256 p2 = _mm256_i32gather_ps(source, _mm256_add_epi32(index, one), 4);
+    __m256 p3 = _mm256_i32gather_ps(source, _mm256_add_epi32(index, _mm256_add_epi32(one, one)), 4);
+    __m256 a = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(three, _mm256_sub_ps(p1, p2)), p3), p0);
+    __m256 b = _mm256_sub_ps(_mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(two, p0), _mm256_mul_ps(five, p1)), _mm256_mul_ps(four, p2)), p3);
+    __m256 c = _mm256_sub_ps(p2, p0);
+    __m256 poly = _mm256_add_ps(c, _mm256_mul_ps(f, _mm256_add_ps(b, _mm256_mul_ps(f, a))));
+    _mm256_storeu_ps(out + i, _mm256_add_ps(p1, _mm256_mul_ps(_mm256_mul_ps(half, f), poly)));
+  }
+#endif
+  for (; i < length; ++i) {
+    int index = static_cast<int>(positions[i]);
+    float f = positions[i] - index;
+    float p0 = source[index - 1];
+    float p1 = source[index];
+    float p2 = source[index + 1];
+    float p3 = source[index + 2];
+    float a = 3.0f * (p1 - p2) + p3 - p0;
+    float b = 2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3;
+    out[i] = p1 + 0.5f * f * ((p2 - p0) + f * (b + f * a));
+  }
+}
+
+
+// kSincCutoffs tables of kSincPhases + 1 rows of kSincTaps
+// Blackman-windowed sinc coefficients, table c having its cutoff c /
+// kSincCutoffsPerOctave octaves below the source's Nyquist frequency, row
+// p being for a fraction of p / kSincPhases and tap t for the frame
+// t - kResampleTapsBefore from the whole part. Each row sums to one.
+std::vector<float> buildSincTable() {
+  const int rows = kSincPhases + 1;
+  std::vector<float> table(kSincCutoffs * rows * kSincTaps);
+  for (int cutoff_index=0; cutoff_index < kSincCutoffs; ++cutoff_index) {
+    double cutoff = exp2(-static_cast<double>(cutoff_index) / kSincCutoffsPerOctave);
+    for (int phase=0; phase < rows; ++phase) {
+      float* row = table.data() + (cutoff_index * rows + phase) * kSincTaps;
+      double fraction = static_cast<double>(phase) / kSincPhases;
+      double sum = 0.0;
+      for (int tap=0; tap < kSincTaps; ++tap) {
+        double x = tap - kResampleTapsBefore - fraction;
+        double sinc = x == 0.0 ? 1.0 : sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+        double u = x / (kSincTaps / 2);
+        double window = std::abs(u) >= 1.0 ? 0.0 : 0.42 + 0.5 * cos(M_PI * u) + 0.08 * cos(2.0 * M_PI * u);
+        row[tap] = sinc * window;
+        sum += sinc * window;
+      }
+      for (int tap=0; tap < kSincTaps; ++tap) row[tap] /= sum;
+    }
+  }
+  return table;
+}
+
+const std::vector<float> kSincTable = buildSincTable();
+
+// Each frame is the dot product of the kSincTaps source frames around it
+// with a row of coefficients blended between the two nearest phases, so
+// the vector body runs across taps rather than frames. The whole block
+// uses the table for its largest step.
+void kernelResampleSinc(const float* source, const float* positions, float* out, int length, float step) {
+  int cutoff_index = step > 1.0f ? std::min(static_cast<int>(std::ceil(std::log2(step) * kSincCutoffsPerOctave)), kSincCutoffs - 1) : 0;
+  const float* table = kSincTable.data() + cutoff_index * (kSincPhases + 1) * kSincTaps;
+  for (int i=0; i < length; ++i) {
+    int index = static_cast<int>(positions[i]);
+    float phase = (positions[i] - index) * kSincPhases;
+    int row = std::min(static_cast<int>(phase), kSincPhases - 1);
+    float blend = phase - row;
+    const float* taps = source + index - kResampleTapsBefore;
+    const float* low = table + row * kSincTaps;
+    const float* high = low + kSincTaps;
+    int tap = 0;
+    float sum = 0.0;
+#ifdef JACK_MIDI_SYNTH_VECTOR_KERNELS
+    vfloat blends = vset(blend);
+    vfloat sums = vset(0.0);
+    for (; tap + kLanes <= kSincTaps; tap += kLanes) {
+      vfloat coefficients = vadd(vload(low + tap), vmul(blends, vsub(vload(high + tap), vload(low + tap))));
+      sums = vadd(sums, vmul(vload(taps + tap), coefficients));
+    }
+    sum = vsum(sums);
+#endif
+    for (; tap < kSincTaps; ++tap) sum += taps[tap] * (low[tap] + blend * (high[tap] - low[tap]));
+    out[i] = sum;
+  }
+}
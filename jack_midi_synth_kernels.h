@@ -0,0 +1,43 @@
+#ifndef JACK_MIDI_SYNTH_KERNELS_H
+#define JACK_MIDI_SYNTH_KERNELS_H
+
+#include <cstdint>
+
+// Block kernels shared by the oscillators. Each one has an AVX or SSE body
+// (whichever the compiler targets) followed by a scalar loop for the tail, so
+// a build without either falls back to plain scalar code.
+
+void kernelPulseWidthModulate(float*, float, int);
+void kernelSine(const float*, float*, int);
+void kernelPulse(const float*, float*, int);
+void kernelTriangle(const float*, float*, int);
+void kernelSaw(const float*, float*, int);
+void kernelReverseSaw(const float*, float*, int);
+void kernelNoise(uint32_t*, float*, int);
+void kernelWavetable(const float*, int, const float*, float*, int);
+void kernelResampleLinear(const float*, const float*, float*, int, float);
+void kernelResampleCubic(const float*, const float*, float*, int, float);
+void kernelResampleSinc(const float*, const float*, float*, int, float);
+
+const int kNoiseLanes = 8;
+
+// The resampling kernels read a source at fractional positions, from up to
+// kResampleTapsBefore frames before a position's whole part to
+// kResampleTapsAfter frames after it, and are given the largest step
+// between positions in the block. The sinc kernel is windowed over
+// kSincTaps frames and kept at kSincPhases fractional offsets, with its
+// cutoff at the source's Nyquist frequency. Reading more than one source
+// frame per output frame, it lowers the cutoff to the output's Nyquist
+// frequency instead, so pitching up doesn't alias; it keeps a table for
+// every kSincCutoffsPerOctave of an octave up to a step of
+// 2^kSincOctaves and rounds down to the cutoff below. The other kernels
+// ignore the step.
+const int kSincTaps = 16;
+const int kSincPhases = 32;
+const int kSincCutoffsPerOctave = 4;
+const int kSincOctaves = 4;
+const int kSincCutoffs = kSincCutoffsPerOctave * kSincOctaves + 1;
+const int kResampleTapsBefore = kSincTaps / 2 - 1;
+const int kResampleTapsAfter = kSincTaps / 2;
+
+#endif // JACK_MIDI_SYNTH_KERNELS_H
@@ -0,0 +1,104 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <map>
+#include <string>
+
+#include "jack_midi_synth_keymap.h"
+#include "jack_midi_synth_sample_manager.h"
+
+
+Keymap::Keymap() : cells(kKeys * kVelocities, -1), group_starts(1, 0), streamed(false) {}
+
+bool Keymap::load(const char* filename) {
+  std::ifstream in(filename);
+  if (!in) {
+    std::cerr << "Unable to open " << filename << std::endl;
+    return false;
+  }
+  std::string directory(filename);
+  size_t slash = directory.rfind('/');
+  directory = slash == std::string::npos ? "" : directory.substr(0, slash + 1);
+  struct Range {
+    int low_key;
+    int high_key;
+    int low_velocity;
+    int high_velocity;
+  };
+  std::vector<Range> ranges;
+  SampleManager& sample_manager(SampleManager::get());
+  std::string line;
+  for (int line_number=1; std::getline(in, line); ++line_number) {
+    size_t comment = line.find('#');
+    if (comment != std::string::npos) line.erase(comment);
+    std::istringstream words(line);
+    std::string path;
+    if (!(words >> path)) continue;
+    std::vector<int> numbers;
+    int number;
+    while (words >> number) numbers.push_back(number);
+    if (!words.eof() || (numbers.size() != 3 && numbers.size() != 5)) {
+      std::cerr << filename << ":" << line_number << ": expected sample, low key, high key, root key and optional velocity range" << std::endl;
+      return false;
+    }
+    int root = numbers[2];
+    Range range = {numbers[0], numbers[1], 0, kVelocities - 1};
+    if (numbers.size() == 5) {
+      range.low_velocity = numbers[3];
+      range.high_velocity = numbers[4];
+    }
+    if (range.low_key < 0 || range.low_key > range.high_key || range.high_key >= kKeys || root < 0 || root >= kKeys || range.low_velocity < 0 || range.low_velocity > range.high_velocity || range.high_velocity >= kVelocities) {
+      std::cerr << filename << ":" << line_number << ": key or velocity out of range" << std::endl;
+      return false;
+    }
+    if (path[0] != '/') path = directory + path;
+    SampleZone zone = {nullptr, sample_manager.getStreamedSample(path.c_str()), static_cast<float>(440.0 * pow(2.0, (root - 69) / 12.0))};
+    if (zone.streamed) streamed = true;
+    else zone.slot = sample_manager.getSampleSlot(path.c_str());
+    zones.push_back(zone);
+    ranges.push_back(range);
+  }
+  // Cells covered by the same zones share a group, numbered in the order
+  // they are first met.
+  std::map<std::vector<int>, int> groups;
+  std::vector<int> covering;
+  for (int key=0; key < kKeys; ++key) {
+    for (int velocity=0; velocity < kVelocities; ++velocity) {
+      covering.clear();
+      for (int zone=0; zone < ranges.size(); ++zone) {
+        const Range& range(ranges[zone]);
+        if (key >= range.low_key && key <= range.high_key && velocity >= range.low_velocity && velocity <= range.high_velocity) covering.push_back(zone);
+      }
+      if (covering.empty()) continue;
+      auto group = groups.find(covering);
+      if (group == groups.end()) {
+        group = groups.insert(std::make_pair(covering, static_cast<int>(group_starts.size()) - 1)).first;
+        group_zones.insert(group_zones.end(), covering.begin(), covering.end());
+        group_starts.push_back(group_zones.size());
+      }
+      cells[key * kVelocities + velocity] = group->second;
+    }
+  }
+  round_robins.assign(groups.size(), 0);
+  return true;
+}
+
+// The round_robin'th zone, counting round, of the group playing note at
+// velocity; null where no zone covers it.
+const SampleZone* Keymap::find(int note, int velocity, unsigned round_robin) const {
+  if (note < 0 || note >= kKeys || velocity < 0 || velocity >= kVelocities) return nullptr;
+  int group = cells[note * kVelocities + velocity];
+  if (group < 0) return nullptr;
+  int first = group_starts[group];
+  return &zones[group_zones[first + round_robin % (group_starts[group + 1] - first)]];
+}
+
+// As find, taking the group's own turn and moving it on. Voices are only
+// triggered from the process thread, so the counters need no atomics.
+const SampleZone* Keymap::next(int note, int velocity) {
+  if (note < 0 || note >= kKeys || velocity < 0 || velocity >= kVelocities) return nullptr;
+  int group = cells[note * kVelocities + velocity];
+  if (group < 0) return nullptr;
+  return find(note, velocity, round_robins[group]++);
+}
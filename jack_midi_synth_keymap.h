@@ -0,0 +1,51 @@
+#ifndef JACK_MIDI_SYNTH_KEYMAP_H
+#define JACK_MIDI_SYNTH_KEYMAP_H
+
+#include <vector>
+
+#include "jack_midi_synth_sample.h"
+
+// One sample of a multisampled instrument and the pitch it was recorded
+// at. Exactly one of slot and streamed is set.
+struct SampleZone {
+  SampleSlot* slot;
+  StreamedSample* streamed;
+  float root_pitch;
+};
+
+
+// Maps every MIDI note and velocity to the zones that cover it, loaded
+// from a text file with one zone per line:
+//
+//   # sample          low high root [low_velocity high_velocity]
+//   piano_c4_p.wav    55  65   60    0  63
+//   piano_c4_f.wav    55  65   60    64 127
+//   piano_c4_f_2.wav  55  65   60    64 127
+//
+// Keys and velocities are inclusive MIDI numbers, velocity defaulting to
+// the whole range, and sample paths are relative to the keymap file.
+// Zones covering the same cells form a round-robin group. Loading works
+// out the group of every note and velocity into one flat table, so a
+// lookup is two indexed reads with no search, allocation or strings and
+// can run on the process thread.
+class Keymap {
+  public:
+    static const int kKeys = 128;
+    static const int kVelocities = 128;
+  private:
+    std::vector<SampleZone> zones;
+    std::vector<int> cells;
+    std::vector<int> group_starts;
+    std::vector<int> group_zones;
+    std::vector<unsigned> round_robins;
+    bool streamed;
+  public:
+    Keymap();
+    bool load(const char*);
+    bool hasStreamedZones() const { return streamed; }
+    int getZoneCount() const { return zones.size(); }
+    const SampleZone* find(int, int, unsigned) const;
+    const SampleZone* next(int, int);
+};
+
+#endif // JACK_MIDI_SYNTH_KEYMAP_H
@@ -1,160 +1,327 @@
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <algorithm>
 #include <cstring>
 #include <cmath>
 
-#include <jack/jack.h>
-#include <jack/midiport.h>
+#include <sys/stat.h>
 
 #include "jack_midi_synth_voice.h"
 #include "jack_midi_synth_logic.h"
 #include "jack_midi_synth_events.h"
+#include "jack_midi_synth_fast_math.h"
+#include "jack_midi_synth_patch.h"
+#include "jack_midi_synth_profiler.h"
+#include "jack_midi_synth_render_program.h"
+#include "jack_midi_synth_sample_manager.h"
 
 
-JackSynth::JackSynth() : JackApp(), global_frame (0), bend_events ({FloatEvent(0, 0.0)}), mod_wheel_events ({FloatEvent(0, 0.0)}), expression_events ({FloatEvent(0, 1.0)}), aftertouch_events ({FloatEvent(0, 0.0)}), sustain_events ({FloatEvent(0, 0.0)}) {
-  add_ports();
+JackSynth::JackSynth(int init_polyphony, VoicePool::StealPolicy init_steal_policy, int init_render_threads, bool init_soa) : sample_rate (0), buffer_size (0), polyphony (init_polyphony), steal_policy (init_steal_policy), voice_pool (nullptr), bank (kMaxPrograms), programs (kMaxPrograms, nullptr), current_program (0), programs_pending (false), retired_programs (kMaxRetiringPrograms), render_threads (init_render_threads), worker_pool (nullptr), soa (init_soa), soa_engine (nullptr), soa_effects (nullptr), global_frame (0), bend_events (0.0), mod_wheel_events (0.0), expression_events (1.0), aftertouch_events (0.0), sustain_events (0.0) {
+  for (auto& next_program: next_programs) next_program.store(nullptr);
+  sounding_programs.reserve(kMaxPrograms + kMaxRetiringPrograms);
 }
 
 JackSynth::~JackSynth() {
-  for (auto voice: voices) delete voice;
+  delete soa_engine;
+  delete soa_effects;
+  delete worker_pool;
+  delete voice_pool;
+  for (auto program: programs) delete program;
+  for (auto& next_program: next_programs) delete next_program.load();
+  RenderProgram* program;
+  while (retired_programs.pop(program)) delete program;
+  for (auto& slot: bank) delete slot.patch;
 }
 
-void JackSynth::activate() {
-  if (jack_activate(client)) {
-    std::cerr << "Unable to activate client" << std::endl;
-    exit(1);
+void JackSynth::activate(int rate, int size, int priority) {
+  sample_rate = rate;
+  bsize(size);
+  initialize_voices(priority);
+}
+
+void JackSynth::initialize_voices(int priority) {
+  if (soa) {
+    soa_engine = new SoaEngine(polyphony, steal_policy);
+    soa_engine->setSampleRate(sample_rate);
+    soa_engine->setBufferSize(buffer_size);
+    soa_effects = new EffectBus(Patch::getDefault());
+    soa_effects->setSampleRate(sample_rate);
+    soa_effects->setBufferSize(buffer_size);
+    return;
+  }
+  for (int number=0; number < kMaxPrograms; ++number) {
+    if (bank[number].patch) programs[number] = compileProgram(*bank[number].patch);
+  }
+  if (!programs[0]) programs[0] = compileProgram(Patch::getDefault());
+  // Compiling only queues the samples, which decode in parallel.
+  SampleManager::get().waitForLoads(std::cerr);
+  current_program = 0;
+  voice_pool = new VoicePool(programs[0], steal_policy);
+  if (render_threads > 0) {
+    worker_pool = new WorkerPool(render_threads, priority);
+    worker_pool->setBufferSize(buffer_size);
+  }
+}
+
+// A lane with no events this period is flagged constant. Otherwise it
+// ramps linearly from each event to the next and holds the last value to
+// the end of the period, walking the events and the frames once.
+void JackSynth::interpolateEvents(const EventLane& lane, ControllerLane& controller) const {
+  if (lane.size() == 1) {
+    controller.setConstant(lane[0].value);
+    return;
+  }
+  int length = controller.size();
+  float* values = controller.setVarying();
+  int i = 0;
+  const FloatEvent* previous = &lane[0];
+  for (int e=1; e < lane.size(); ++e) {
+    const FloatEvent& event = lane[e];
+    if (event.frame > previous->frame) {
+      float slope = (event.value - previous->value) / (event.frame - previous->frame);
+      int end = std::min(event.frame + 1, length);
+      for (; i < end; ++i) values[i] = previous->value + (i - previous->frame) * slope;
+    }
+    previous = &event;
   }
-  initialize_voices();
-  connect_ports();
+  for (; i < length; ++i) values[i] = previous->value;
 }
 
-void JackSynth::initialize_voices() {
-  for(int i=0;i<128;i++) {
-    voices.push_back(new Voice(i));
-    voices.back()->setSampleRate(sample_rate);
-    voices.back()->setBufferSize(buffer_size);
+void JackSynth::bendToFreq() {
+  if (bend.isConstant()) {
+    bend_freq.setConstant(fastExp2(bend.getValue()));
+    return;
   }
+  float* values = bend_freq.setVarying();
+  for (int i=0; i < bend.size(); ++i) values[i] = fastExp2(bend[i]);
 }
 
-void JackSynth::cycleEventList(std::list<FloatEvent>& event_list) const {
-  FloatEvent last_event = event_list.back();
-  last_event.frame -= buffer_size;
-  event_list.clear();
-  event_list.push_back(last_event);
+RenderProgram* JackSynth::compileProgram(const Patch& patch) const {
+  RenderProgram* program = new RenderProgram(patch, polyphony);
+  program->setSampleRate(sample_rate);
+  program->setBufferSize(buffer_size);
+  return program;
 }
 
-void JackSynth::interpolateEvents(const std::list<FloatEvent>& event_list, std::vector<float>& values) const {
-  if (event_list.size() == 1) {
-    for (auto& value: values) value = event_list.back().value;
-  } else {
-    FloatEvent previous_event = event_list.front();
-    bool first = true;
-    int offset = 0;
-    for (const auto& event: event_list) {
-      if (first) { first = false; continue; }
-      for (int i=offset; i < values.size() ; ++i) {
-        if (previous_event.frame < i && i <= event.frame) {
-          values[i] = previous_event.value + (i - previous_event.frame) * (event.value - previous_event.value) / (event.frame - previous_event.frame);
-        } else {
-          previous_event = event;
-          values[i] = event.value;
-          offset = i;
-          break;
-        }
-      }
+// Parses and compiles on the calling thread, never the process thread. A
+// program published before the last one for its slot was picked up is
+// simply replaced.
+bool JackSynth::loadPatch(const char* filename, int number) {
+  if (soa) {
+    std::cerr << "The soa engine only plays the built-in patch" << std::endl;
+    return false;
+  }
+  if (number < 0 || number >= kMaxPrograms) {
+    std::cerr << "Program numbers run from 0 to " << kMaxPrograms - 1 << std::endl;
+    return false;
+  }
+  BankSlot& slot = bank[number];
+  slot.filename = filename;
+  slot.time = modificationTime(filename);
+  Patch* patch = new Patch;
+  if (!patch->load(filename)) {
+    delete patch;
+    return false;
+  }
+  delete slot.patch;
+  slot.patch = patch;
+  if (voice_pool) {
+    delete next_programs[number].exchange(compileProgram(*patch), std::memory_order_acq_rel);
+    programs_pending.store(true, std::memory_order_release);
+  }
+  return true;
+}
+
+// Each line of a bank file is a program number and the patch file to load
+// into it.
+bool JackSynth::loadBank(const char* filename) {
+  std::ifstream in(filename);
+  if (!in) {
+    std::cerr << "Unable to open " << filename << std::endl;
+    return false;
+  }
+  std::string line;
+  for (int line_number=1; std::getline(in, line); ++line_number) {
+    std::istringstream words(line);
+    int number;
+    std::string patch_filename;
+    words >> std::ws;
+    if (words.eof() || words.peek() == '#') continue;
+    if (!(words >> number >> patch_filename)) {
+      std::cerr << filename << ":" << line_number << ": expected a program number and a patch file" << std::endl;
+      return false;
     }
-    for (int i=offset; i < values.size(); ++i) values[i] = previous_event.value;
+    if (!loadPatch(patch_filename.c_str(), number)) return false;
   }
+  return true;
 }
 
-void JackSynth::bendToFreq() {
-  for (int i=0; i < bend.size(); ++i) bend_freq[i] = pow(2.0, bend[i]);
-}
-
-int JackSynth::process(jack_nframes_t nframes) {
-  if (midi_input_ports.size() > 0) {
-    cycleEventList(bend_events);
-    cycleEventList(mod_wheel_events);
-    cycleEventList(expression_events);
-    cycleEventList(aftertouch_events);
-    cycleEventList(sustain_events);
-    auto in_port = midi_input_ports.front();
-    auto in = jack_port_get_buffer(in_port, nframes);
-    for (int i=0; i < jack_midi_get_event_count(in); ++i) {
-      jack_midi_event_t event;
-      jack_midi_event_get(&event, in, i);
-      int operation = 0;
-      int channel = 0;
-      if (event.size > 0) {
-        operation = event.buffer[0] >> 4;
-        channel = event.buffer[0] & 0xF;
-      }
-      if (operation == 9) {
-        voices[event.buffer[1]]->triggerVoice(event.buffer[2] / 127.0, global_frame + event.time);
-      } else if (operation == 8) {
-        voices[event.buffer[1]]->releaseVoice();
-      } else if (operation == 11) {
-        if (event.buffer[1] == 1) {
-          mod_wheel_events.push_back(FloatEvent(event.time, event.buffer[2] / 127.0));
-        } else if (event.buffer[1] == 11) {
-          expression_events.push_back(FloatEvent(event.time, event.buffer[2] / 127.0));
-        } else if (event.buffer[1] == 64) {
-          sustain_events.push_back(FloatEvent(event.time, event.buffer[2] /127));
-        }
-      } else if (operation == 12) {
-      } else if (operation == 13) {
-        aftertouch_events.push_back(FloatEvent(event.time, event.buffer[1] / 127.0));
-      } else if (operation == 14) {
-        bend_events.push_back(FloatEvent(event.time, *reinterpret_cast<short*>(event.buffer + 1) / 16384.0 - 1.0));
-      }
+// Frees the programs and sample versions process has finished with and
+// reloads any patch or sample file that has changed on disk.
+void JackSynth::idle() {
+  RenderProgram* program;
+  while (retired_programs.pop(program)) delete program;
+  SampleManager& sample_manager(SampleManager::get());
+  sample_manager.collect();
+  sample_manager.reloadChanged();
+  for (int number=0; number < kMaxPrograms; ++number) {
+    BankSlot& slot = bank[number];
+    if (!slot.filename.empty() && modificationTime(slot.filename.c_str()) != slot.time) {
+      std::cerr << "Reloading " << slot.filename << std::endl;
+      loadPatch(slot.filename.c_str(), number);
     }
   }
-  interpolateEvents(bend_events, bend);
-  interpolateEvents(mod_wheel_events, mod_wheel);
-  interpolateEvents(expression_events, expression);
-  interpolateEvents(aftertouch_events, aftertouch);
-  interpolateEvents(sustain_events, sustain);
-  bendToFreq();
-  if (audio_output_ports.size() > 0) {
-    auto out_port = audio_output_ports.front();
-    auto out = reinterpret_cast<float*>(jack_port_get_buffer(out_port, nframes));
-    memset(out, 0, nframes * 4);
-    for (int note_num=0; note_num < voices.size() ; ++note_num) {
-      voices[note_num]->update(&bend, &bend_freq, &mod_wheel, &expression, &aftertouch, &sustain);
-      if (voices[note_num]->isSounding()) voices[note_num]->render(out, global_frame, nframes);
+}
+
+// Runs on the process thread. A program that has been replaced is retired
+// through the voice pool so its sounding voices can finish; if the pool
+// has no room to retire another, the rest wait for a later period.
+void JackSynth::swapPrograms() {
+  for (int number=0; number < kMaxPrograms; ++number) {
+    if (!next_programs[number].load(std::memory_order_relaxed)) continue;
+    if (programs[number] && !voice_pool->canRetireProgram()) {
+      programs_pending.store(true, std::memory_order_relaxed);
+      return;
     }
-    for (int frame=0; frame < nframes; ++frame) out[frame] = tanh(out[frame]) / 1.5707963;
+    if (programs[number]) voice_pool->retireProgram(programs[number]);
+    programs[number] = next_programs[number].exchange(nullptr, std::memory_order_acq_rel);
+    if (number == current_program) voice_pool->setProgram(programs[number]);
   }
-  global_frame += nframes;
-  return 0;
 }
 
-void JackSynth::add_ports() {
-  midi_input_ports.push_back(jack_port_register(client, "midi_input", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0));
-  audio_output_ports.push_back(jack_port_register(client, "audio_output", JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0));
+// Sorts this period's voices by the program they were started on, listing
+// any program that isn't already. The list is reserved for every program
+// that can exist at once, so this never allocates.
+void JackSynth::listPrograms() {
+  for (auto program: sounding_programs) program->clearSounding();
+  RenderProgram* current = programs[current_program];
+  if (!current->isListed()) {
+    current->setListed(true);
+    sounding_programs.push_back(current);
+  }
+  const std::vector<VoiceBase*>& voices = voice_pool->getActive();
+  const std::vector<RenderProgram*>& owners = voice_pool->getActivePrograms();
+  for (int i=0; i < voices.size(); ++i) {
+    if (!owners[i]->isListed()) {
+      owners[i]->setListed(true);
+      sounding_programs.push_back(owners[i]);
+    }
+    owners[i]->addSounding(voices[i]);
+  }
 }
 
-void JackSynth::connect_ports() {
-  const char **ports;
+// Takes off every program other than the current one that has no voices
+// left and whose bus has rung out, leaving a retired one free to be
+// deleted.
+void JackSynth::unlistQuietPrograms() {
+  RenderProgram* current = programs[current_program];
+  auto kept = std::remove_if(sounding_programs.begin(), sounding_programs.end(), [current](RenderProgram* program) {
+    if (program == current || !program->getSounding().empty() || program->getEffects().isRinging()) return false;
+    program->setListed(false);
+    return true;
+  });
+  sounding_programs.erase(kept, sounding_programs.end());
+}
 
-  if((ports = jack_get_ports(client, NULL, JACK_DEFAULT_AUDIO_TYPE, JackPortIsPhysical|JackPortIsTerminal|JackPortIsInput)) == NULL) {
-    std::cerr << "Cannot find any physical playback ports" << std::endl;
+int JackSynth::process(const MidiEvent* events, int event_count, float* out, int nframes) {
+  if (voice_pool && programs_pending.exchange(false, std::memory_order_acquire)) swapPrograms();
+  bend_events.cycle(buffer_size);
+  mod_wheel_events.cycle(buffer_size);
+  expression_events.cycle(buffer_size);
+  aftertouch_events.cycle(buffer_size);
+  sustain_events.cycle(buffer_size);
+  for (int i=0; i < event_count; ++i) {
+    const MidiEvent& event = events[i];
+    int operation = 0;
+    int channel = 0;
+    if (event.size > 0) {
+      operation = event.buffer[0] >> 4;
+      channel = event.buffer[0] & 0xF;
+    }
+    if (operation == 9 && event.buffer[2] > 0) {
+      if (soa_engine) soa_engine->noteOn(event.buffer[1], event.buffer[2] / 127.0, global_frame + event.time);
+      else voice_pool->noteOn(event.buffer[1], event.buffer[2] / 127.0, global_frame + event.time);
+    } else if (operation == 8 || operation == 9) {
+      if (soa_engine) soa_engine->noteOff(event.buffer[1]);
+      else voice_pool->noteOff(event.buffer[1]);
+    } else if (operation == 11) {
+      if (event.buffer[1] == 1) {
+        mod_wheel_events.push(event.time, event.buffer[2] / 127.0);
+      } else if (event.buffer[1] == 11) {
+        expression_events.push(event.time, event.buffer[2] / 127.0);
+      } else if (event.buffer[1] == 64) {
+        sustain_events.push(event.time, event.buffer[2] /127);
+      }
+    } else if (operation == 12) {
+      int number = event.buffer[1] & 0x7F;
+      if (voice_pool && programs[number] && number != current_program) {
+        current_program = number;
+        voice_pool->setProgram(programs[number]);
+      }
+    } else if (operation == 13) {
+      aftertouch_events.push(event.time, event.buffer[1] / 127.0);
+    } else if (operation == 14) {
+      bend_events.push(event.time, *reinterpret_cast<const short*>(event.buffer + 1) / 16384.0 - 1.0);
+    }
   }
-
-  for (int i=0; ports[i]; ++i) {
-    if(jack_connect(client, jack_port_name(audio_output_ports.front()), ports[i])) {
-      std::cerr << "cannot connect output ports" << std::endl;
+  {
+    PROFILE_SCOPE(PROFILE_CONTROLLERS);
+    interpolateEvents(bend_events, bend);
+    interpolateEvents(mod_wheel_events, mod_wheel);
+    interpolateEvents(expression_events, expression);
+    interpolateEvents(aftertouch_events, aftertouch);
+    interpolateEvents(sustain_events, sustain);
+    bendToFreq();
+  }
+  memset(out, 0, nframes * sizeof(float));
+  if (soa_engine) {
+    // The built-in patch sends the whole of every voice.
+    soa_engine->render(bend_freq, mod_wheel, expression, aftertouch, sustain, soa_effects->getSend(), global_frame, nframes);
+    soa_engine->retireSilent();
+    soa_effects->process(out, nframes);
+  } else {
+    for (auto voice: voice_pool->getActive()) voice->update(&bend, &bend_freq, &mod_wheel, &expression, &aftertouch, &sustain);
+    listPrograms();
+    for (auto program: sounding_programs) {
+      EffectBus& bus = program->getEffects();
+      if (!worker_pool) {
+        for (auto voice: program->getSounding()) voice->render(out, bus.getSend(), global_frame, nframes);
+      } else if (!program->getSounding().empty()) {
+        worker_pool->render(program->getSounding(), out, bus.getSend(), global_frame, nframes);
+      }
+      bus.process(out, nframes);
+    }
+    voice_pool->retireSilent();
+    unlistQuietPrograms();
+    RenderProgram* idle_program;
+    while (retired_programs.size() < retired_programs.capacity() && (idle_program = voice_pool->takeIdleProgram())) {
+      retired_programs.push(idle_program);
     }
   }
-
-  jack_free(ports);
+  {
+    PROFILE_SCOPE(PROFILE_MASTER_TANH);
+    for (int frame=0; frame < nframes; ++frame) out[frame] = fastTanh(out[frame]) / 1.5707963f;
+  }
+  PROFILE_PERIOD();
+  SampleManager::get().passCycle();
+  global_frame += nframes;
+  return 0;
 }
 
-int JackSynth::srate(jack_nframes_t nframes) {
-  for (auto voice: voices) voice->setSampleRate(nframes);
+int JackSynth::srate(int nframes) {
+  sample_rate = nframes;
+  for (auto program: programs) {
+    if (program) program->setSampleRate(nframes);
+  }
+  if (voice_pool) voice_pool->setSampleRate(nframes);
+  if (soa_engine) soa_engine->setSampleRate(nframes);
+  if (soa_effects) soa_effects->setSampleRate(nframes);
   return 0;
 }
 
-int JackSynth::bsize(jack_nframes_t nframes) {
+int JackSynth::bsize(int nframes) {
   buffer_size = nframes;
   bend.resize(nframes);
   bend_freq.resize(nframes);
@@ -162,10 +329,21 @@ int JackSynth::bsize(jack_nframes_t nframes) {
   expression.resize(nframes);
   aftertouch.resize(nframes);
   sustain.resize(nframes);
-  for (auto voice: voices) voice->setBufferSize(nframes);
+  for (auto program: programs) {
+    if (program) program->setBufferSize(nframes);
+  }
+  if (voice_pool) voice_pool->setBufferSize(nframes);
+  if (soa_engine) soa_engine->setBufferSize(nframes);
+  if (soa_effects) soa_effects->setBufferSize(nframes);
+  if (worker_pool) worker_pool->setBufferSize(nframes);
   return 0;
 }
 
-void JackSynth::jack_shutdown() {
+int JackSynth::getActiveVoices() const {
+  if (soa_engine) return soa_engine->getActive();
+  return voice_pool ? voice_pool->getActive().size() : 0;
+}
+
+void JackSynth::shutdown() {
   exit(1);
 }
@@ -1,46 +1,94 @@
 #ifndef JACK_MIDI_SYNTH_LOGIC_H
 #define JACK_MIDI_SYNTH_LOGIC_H
 
+#include <atomic>
+#include <ctime>
+#include <string>
 #include <vector>
-#include <list>
 
-#include <jack/types.h>
+#include "jack_midi_synth_backend.h"
+#include "jack_midi_synth_effect_bus.h"
+#include "jack_midi_synth_events.h"
+#include "jack_midi_synth_ring_buffer.h"
+#include "jack_midi_synth_soa_engine.h"
+#include "jack_midi_synth_voice_pool.h"
+#include "jack_midi_synth_worker_pool.h"
 
-#include "jack_midi_synth_app.h"
+class Patch;
+class RenderProgram;
 
-class Voice;
-struct FloatEvent;
+const int kMaxPrograms = 128;
 
-class JackSynth : public JackApp {
+// Holds a bank of up to kMaxPrograms patches, each compiled into its own
+// RenderProgram when the synth is activated, so a MIDI program change
+// only repoints the voice pool. A patch loaded while running is compiled
+// on the calling thread and published through its slot in next_programs;
+// process picks it up with one atomic exchange at the top of a period,
+// and hands programs that have gone quiet back through retired_programs
+// to be deleted in idle, so the process thread never allocates, frees or
+// waits.
+//
+// Voices split their output between out and the send of the program they
+// were started on, so a note held across a program change keeps feeding
+// its own program's effects. Each period the programs with sounding
+// voices, and the current one, are listed in sounding_programs; a program
+// stays listed, its bus running on silence, until its voices have gone
+// and its tail has rung out.
+class JackSynth : public AudioProcessor {
   private:
-    std::vector<Voice*> voices;
-    std::list<jack_port_t*> midi_input_ports;
-    std::list<jack_port_t*> audio_output_ports;
+    struct BankSlot {
+      BankSlot() : patch(nullptr), time(0) {}
+      Patch* patch;
+      std::string filename;
+      time_t time;
+    };
+    int sample_rate;
+    int buffer_size;
+    int polyphony;
+    VoicePool::StealPolicy steal_policy;
+    VoicePool* voice_pool;
+    std::vector<BankSlot> bank;
+    std::vector<RenderProgram*> programs;
+    int current_program;
+    std::atomic<RenderProgram*> next_programs[kMaxPrograms];
+    std::atomic<bool> programs_pending;
+    RingBuffer<RenderProgram*> retired_programs;
+    RenderProgram* compileProgram(const Patch&) const;
+    void swapPrograms();
+    int render_threads;
+    WorkerPool* worker_pool;
+    bool soa;
+    SoaEngine* soa_engine;
+    EffectBus* soa_effects;
+    std::vector<RenderProgram*> sounding_programs;
+    void listPrograms();
+    void unlistQuietPrograms();
     int global_frame;
-    std::list<FloatEvent> bend_events;
-    std::list<FloatEvent> mod_wheel_events;
-    std::list<FloatEvent> expression_events;
-    std::list<FloatEvent> aftertouch_events;
-    std::list<FloatEvent> sustain_events;
-    std::vector<float> bend;
-    std::vector<float> bend_freq;
-    std::vector<float> mod_wheel;
-    std::vector<float> expression;
-    std::vector<float> aftertouch;
-    std::vector<float> sustain;
+    EventLane bend_events;
+    EventLane mod_wheel_events;
+    EventLane expression_events;
+    EventLane aftertouch_events;
+    EventLane sustain_events;
+    ControllerLane bend;
+    ControllerLane bend_freq;
+    ControllerLane mod_wheel;
+    ControllerLane expression;
+    ControllerLane aftertouch;
+    ControllerLane sustain;
   public:
-    JackSynth();
+    JackSynth(int=32, VoicePool::StealPolicy=VoicePool::STEAL_OLDEST, int=0, bool=false);
     ~JackSynth();
-    void activate();
-    void add_ports();
-    void connect_ports();
-    void initialize_voices();
-    virtual int srate(jack_nframes_t) override;
-    virtual int bsize(jack_nframes_t) override;
-    virtual void jack_shutdown() override;
-    virtual int process(jack_nframes_t) override;
-    void cycleEventList(std::list<FloatEvent>&) const;
-    void interpolateEvents(const std::list<FloatEvent>&, std::vector<float>&) const;
+    virtual void activate(int, int, int) override;
+    void initialize_voices(int);
+    virtual int srate(int) override;
+    virtual int bsize(int) override;
+    virtual void shutdown() override;
+    virtual void idle() override;
+    bool loadPatch(const char*, int=0);
+    bool loadBank(const char*);
+    virtual int getActiveVoices() const override;
+    virtual int process(const MidiEvent*, int, float*, int) override;
+    void interpolateEvents(const EventLane&, ControllerLane&) const;
     void bendToFreq();
 };
 
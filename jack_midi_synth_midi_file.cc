@@ -0,0 +1,132 @@
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <cstring>
+
+#include "jack_midi_synth_midi_file.h"
+
+
+struct TickEvent {
+  long tick;
+  int order;
+  int tempo;
+  TimedMidiEvent event;
+};
+
+class MidiReader {
+  private:
+    const std::vector<unsigned char>& data;
+    size_t position;
+    size_t end;
+  public:
+    MidiReader(const std::vector<unsigned char>& init_data, size_t init_position, size_t init_end) : data(init_data), position(init_position), end(init_end) {}
+    bool done() const { return position >= end; }
+    size_t tell() const { return position; }
+    void skip(size_t count) { position += count; }
+    int byte() { return position < end ? data[position++] : 0; }
+    int peek() const { return position < end ? data[position] : 0; }
+    long number(int bytes) {
+      long value = 0;
+      for (int i=0; i < bytes; ++i) value = (value << 8) | byte();
+      return value;
+    }
+    long variable() {
+      long value = 0;
+      for (int i=0; i < 4 && !done(); ++i) {
+        int next = byte();
+        value = (value << 7) | (next & 0x7F);
+        if (!(next & 0x80)) break;
+      }
+      return value;
+    }
+};
+
+
+MidiFile::MidiFile(const char* filename) : loaded(false) {
+  std::ifstream file(filename, std::ios::binary);
+  if (!file) {
+    std::cerr << "Unable to open MIDI file " << filename << std::endl;
+    return;
+  }
+  std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  if (data.size() < 14 || memcmp(data.data(), "MThd", 4) != 0) {
+    std::cerr << filename << " is not a Standard MIDI File" << std::endl;
+    return;
+  }
+  MidiReader header(data, 4, data.size());
+  long header_length = header.number(4);
+  header.number(2);
+  int tracks = header.number(2);
+  int division = header.number(2);
+  header.skip(header_length - 6);
+
+  std::vector<TickEvent> tick_events;
+  size_t track_start = header.tell();
+  for (int track=0; track < tracks && track_start + 8 <= data.size(); ++track) {
+    MidiReader chunk(data, track_start, data.size());
+    bool is_track = memcmp(data.data() + track_start, "MTrk", 4) == 0;
+    chunk.skip(4);
+    long length = chunk.number(4);
+    track_start = chunk.tell() + length;
+    if (!is_track) {
+      --track;
+      continue;
+    }
+    MidiReader reader(data, chunk.tell(), std::min(track_start, data.size()));
+    long tick = 0;
+    int status = 0;
+    while (!reader.done()) {
+      tick += reader.variable();
+      if (reader.peek() & 0x80) status = reader.byte();
+      if (status == 0xFF) {
+        int type = reader.byte();
+        long meta_length = reader.variable();
+        if (type == 0x51 && meta_length == 3) {
+          TickEvent tempo_event = {tick, static_cast<int>(tick_events.size()), static_cast<int>(reader.number(3))};
+          tick_events.push_back(tempo_event);
+        } else {
+          reader.skip(meta_length);
+        }
+        if (type == 0x2F) break;
+        status = 0;
+      } else if (status == 0xF0 || status == 0xF7) {
+        reader.skip(reader.variable());
+        status = 0;
+      } else if (status & 0x80) {
+        TickEvent channel_event = {tick, static_cast<int>(tick_events.size()), 0};
+        int type = status >> 4;
+        channel_event.event.size = (type == 12 || type == 13) ? 2 : 3;
+        channel_event.event.buffer[0] = status;
+        for (int i=1; i < channel_event.event.size; ++i) channel_event.event.buffer[i] = reader.byte();
+        tick_events.push_back(channel_event);
+      } else {
+        reader.byte();
+      }
+    }
+  }
+
+  std::stable_sort(tick_events.begin(), tick_events.end(), [](const TickEvent& a, const TickEvent& b) { return a.tick < b.tick; });
+  double seconds_per_tick = 0.5 / division;
+  if (division & 0x8000) {
+    int frames_per_second = -static_cast<signed char>(division >> 8);
+    seconds_per_tick = 1.0 / (frames_per_second * (division & 0xFF));
+  }
+  double seconds = 0.0;
+  long last_tick = 0;
+  for (auto& tick_event: tick_events) {
+    seconds += (tick_event.tick - last_tick) * seconds_per_tick;
+    last_tick = tick_event.tick;
+    if (tick_event.tempo) {
+      if (!(division & 0x8000)) seconds_per_tick = tick_event.tempo / 1000000.0 / division;
+    } else {
+      tick_event.event.time = seconds;
+      events.push_back(tick_event.event);
+    }
+  }
+  loaded = true;
+}
+
+double MidiFile::getDuration() const {
+  return events.size() ? events.back().time : 0.0;
+}
@@ -0,0 +1,26 @@
+#ifndef JACK_MIDI_SYNTH_MIDI_FILE_H
+#define JACK_MIDI_SYNTH_MIDI_FILE_H
+
+#include <vector>
+
+struct TimedMidiEvent {
+  double time;
+  int size;
+  unsigned char buffer[3];
+};
+
+// Reads the channel messages out of a Standard MIDI File (format 0 or 1),
+// merges the tracks and converts their times to seconds using the tempo
+// map. Meta events other than tempo, and system exclusive, are dropped.
+class MidiFile {
+  private:
+    std::vector<TimedMidiEvent> events;
+    bool loaded;
+  public:
+    MidiFile(const char*);
+    bool isLoaded() const { return loaded; }
+    const std::vector<TimedMidiEvent>& getEvents() const { return events; }
+    double getDuration() const;
+};
+
+#endif // JACK_MIDI_SYNTH_MIDI_FILE_H
@@ -0,0 +1,65 @@
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <vector>
+
+#include "jack_midi_synth_offline.h"
+#include "jack_midi_synth_telemetry.h"
+#include "jack_midi_synth_profiler.h"
+
+
+OfflineApp::OfflineApp(AudioProcessor* init_processor, const char* midi_filename, const char* init_output_filename, int rate, int size, float init_tail) : AudioBackend(init_processor), midi_file(midi_filename), output_filename(init_output_filename), output(nullptr), tail(init_tail) {
+  sample_rate = rate;
+  buffer_size = size;
+  if (!midi_file.isLoaded()) exit(1);
+}
+
+OfflineApp::~OfflineApp() {
+  if (output) sf_close(output);
+}
+
+void OfflineApp::activate() {
+  SF_INFO sfinfo;
+  sfinfo.samplerate = sample_rate;
+  sfinfo.channels = 1;
+  sfinfo.format = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+  output = sf_open(output_filename, SFM_WRITE, &sfinfo);
+  if (!output) {
+    std::cerr << "Unable to open " << output_filename << ": " << sf_strerror(NULL) << std::endl;
+    exit(1);
+  }
+  processor->activate(sample_rate, buffer_size, 0);
+}
+
+void OfflineApp::run() {
+  const std::vector<TimedMidiEvent>& events = midi_file.getEvents();
+  std::vector<MidiEvent> block_events;
+  block_events.reserve(events.size());
+  std::vector<float> block(buffer_size);
+  long total_frames = static_cast<long>(ceil((midi_file.getDuration() + tail) * sample_rate));
+  int next = 0;
+  long next_idle = sample_rate;
+  auto start = std::chrono::steady_clock::now();
+  for (long frame=0; frame < total_frames; frame += buffer_size) {
+    block_events.clear();
+    while (next < events.size()) {
+      long event_frame = static_cast<long>(events[next].time * sample_rate + 0.5);
+      if (event_frame >= frame + buffer_size) break;
+      block_events.push_back(MidiEvent(std::max(0L, event_frame - frame), events[next].size, events[next].buffer));
+      ++next;
+    }
+    processCycle(block_events.data(), block_events.size(), block.data(), buffer_size);
+    sf_writef_float(output, block.data(), buffer_size);
+    if (telemetry) telemetry->drain();
+    if (frame + buffer_size >= next_idle) {
+      processor->idle();
+      next_idle += sample_rate;
+    }
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  double rendered = static_cast<double>(total_frames) / sample_rate;
+  std::cerr << "Rendered " << rendered << "s of audio in " << elapsed.count() << "s, real-time factor " << elapsed.count() / rendered << " (" << rendered / elapsed.count() << "x real time)" << std::endl;
+  if (telemetry) telemetry->report(*telemetry_out);
+  PROFILE_REPORT(telemetry ? *telemetry_out : std::cerr);
+}
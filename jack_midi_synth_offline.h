@@ -0,0 +1,24 @@
+#ifndef JACK_MIDI_SYNTH_OFFLINE_H
+#define JACK_MIDI_SYNTH_OFFLINE_H
+
+#include <sndfile.h>
+
+#include "jack_midi_synth_backend.h"
+#include "jack_midi_synth_midi_file.h"
+
+// Plays a MIDI file through the processor in fixed-size blocks as fast as
+// it will go and writes the result to a WAV file.
+class OfflineApp : public AudioBackend {
+  private:
+    MidiFile midi_file;
+    const char* output_filename;
+    SNDFILE* output;
+    float tail;
+  public:
+    OfflineApp(AudioProcessor*, const char*, const char*, int=48000, int=256, float=2.0);
+    ~OfflineApp();
+    virtual void activate() override;
+    virtual void run() override;
+};
+
+#endif // JACK_MIDI_SYNTH_OFFLINE_H
@@ -1,11 +1,27 @@
 #include "jack_midi_synth_oscillators.h"
 
+#include <algorithm>
+
+#include "jack_midi_synth_disk_streamer.h"
+#include "jack_midi_synth_fast_math.h"
+#include "jack_midi_synth_keymap.h"
 #include "jack_midi_synth_sample_manager.h"
+#include "jack_midi_synth_wavetable.h"
+
+
+void Oscillator::render(const float* phase_steps, float* out, int length) {
+  for (int frame=0; frame < length; ++frame) out[frame] = getAmplitude(phase_steps[frame]);
+}
+
+
+void Oscillator::renderSteady(float phase_step, float* out, int length) {
+  for (int frame=0; frame < length; ++frame) out[frame] = getAmplitude(phase_step);
+}
 
 
 float PitchedOscillator::advanceOffset(float phase_step) {
   offset += phase_step * tuning;
-  offset = fmod(offset, 1.0);
+  offset = wrapPhase(offset);
   return pulseWidthModulate(offset);
 }
 
@@ -16,8 +32,47 @@ float PitchedOscillator::pulseWidthModulate(float offset) {
 }
 
 
+void PitchedOscillator::advanceOffsets(const float* phase_steps, float* offsets, int length) {
+  for (int frame=0; frame < length; ++frame) {
+    offset += phase_steps[frame] * tuning;
+    if (offset >= 1.0) offset -= static_cast<int>(offset);
+    offsets[frame] = offset;
+  }
+  kernelPulseWidthModulate(offsets, pulse_centre, length);
+}
+
+
+// Written the same way as the per-frame version so both round alike when
+// the compiler fuses the multiply-add.
+void PitchedOscillator::advanceOffsets(float phase_step, float* offsets, int length) {
+  for (int frame=0; frame < length; ++frame) {
+    offset += phase_step * tuning;
+    if (offset >= 1.0) offset -= static_cast<int>(offset);
+    offsets[frame] = offset;
+  }
+  kernelPulseWidthModulate(offsets, pulse_centre, length);
+}
+
+
+void PitchedOscillator::render(const float* phase_steps, float* out, int length) {
+  advanceOffsets(phase_steps, out, length);
+  shape(out, out, length);
+}
+
+
+void PitchedOscillator::renderSteady(float phase_step, float* out, int length) {
+  advanceOffsets(phase_step, out, length);
+  shape(out, out, length);
+}
+
+
 float Sine::getAmplitude(float phase_step) {
-  return sin(advanceOffset(phase_step) * 6.2831853);
+  return fastSin2Pi(advanceOffset(phase_step));
+}
+
+
+void Sine::shape(const float* offsets, float* out, int length) {
+  kernelSine(offsets, out, length);
 }
 
 
@@ -37,35 +92,240 @@ float Pulse::getAmplitude(float phase_step) {
 }
 
 
+void Pulse::shape(const float* offsets, float* out, int length) {
+  kernelPulse(offsets, out, length);
+}
+
+
 float Triangle::getAmplitude(float phase_step) {
   float local_offset = advanceOffset(phase_step);
   return local_offset < 0.5 ? (4.0 * local_offset - 1.0) : (3.0 - (4.0 * local_offset));
 }
 
 
+void Triangle::shape(const float* offsets, float* out, int length) {
+  kernelTriangle(offsets, out, length);
+}
+
+
 float Saw::getAmplitude(float phase_step) {
   return (2.0 * advanceOffset(phase_step)) - 1.0;
 }
 
 
+void Saw::shape(const float* offsets, float* out, int length) {
+  kernelSaw(offsets, out, length);
+}
+
+
 float ReverseSaw::getAmplitude(float phase_step) {
   return 1.0 - (2.0 * advanceOffset(phase_step));
 }
 
 
+void ReverseSaw::shape(const float* offsets, float* out, int length) {
+  kernelReverseSaw(offsets, out, length);
+}
+
+
+WavetableOscillator::WavetableOscillator(const Wavetable* init_table, float tune) : PitchedOscillator(tune, "Wavetable"), table(init_table), level(0) {}
+
+
+float WavetableOscillator::getAmplitude(float phase_step) {
+  float value;
+  float local_offset = advanceOffset(phase_step);
+  level = table->getLevel(phase_step * tuning);
+  shape(&local_offset, &value, 1);
+  return value;
+}
+
+
+void WavetableOscillator::shape(const float* offsets, float* out, int length) {
+  kernelWavetable(table->getLevelData(level), kWavetableSize, offsets, out, length);
+}
+
+
+void WavetableOscillator::render(const float* phase_steps, float* out, int length) {
+  float fastest = 0.0;
+  for (int frame=0; frame < length; ++frame) fastest = std::max(fastest, phase_steps[frame]);
+  level = table->getLevel(fastest * tuning);
+  PitchedOscillator::render(phase_steps, out, length);
+}
+
+
+void WavetableOscillator::renderSteady(float phase_step, float* out, int length) {
+  level = table->getLevel(phase_step * tuning);
+  PitchedOscillator::renderSteady(phase_step, out, length);
+}
+
+
+Noise::Noise() : Oscillator("Noise") {
+  for (int lane=0; lane < kNoiseLanes; ++lane) states[lane] = 2463534242u + 2654435761u * lane;
+}
+
+
 float Noise::getAmplitude(float phase_step) {
-  return distribution(generator);
+  float value;
+  kernelNoise(states, &value, 1);
+  return value;
+}
+
+
+void Noise::render(const float* phase_steps, float* out, int length) {
+  kernelNoise(states, out, length);
+}
+
+
+void Noise::renderSteady(float phase_step, float* out, int length) {
+  kernelNoise(states, out, length);
 }
 
-Audio::Audio(const char* filename, float init_pitch) : Oscillator("Audio"), sample(0) {
+void (*const kResampleKernels[Audio::kNumInterpolations])(const float*, const float*, float*, int, float) = {
+  nullptr,
+  kernelResampleLinear,
+  kernelResampleCubic,
+  kernelResampleSinc
+};
+
+Audio::Audio(const char* filename, Interpolation init_interpolation, float init_root_pitch) : Audio(init_interpolation, "Audio") {
   SampleManager& sample_manager(SampleManager::get());
-  audio = sample_manager.getSample(filename);
+  StreamedSample* streamed_sample = sample_manager.getStreamedSample(filename);
+  if (streamed_sample) {
+    stream = new SampleStream(streamed_sample);
+    select(nullptr, streamed_sample, init_root_pitch);
+  } else {
+    select(sample_manager.getSampleSlot(filename), nullptr, init_root_pitch);
+  }
+}
+
+// Plays silence until select gives it a sample.
+Audio::Audio(Interpolation init_interpolation, const char* init_type) : Oscillator(init_type), slot(nullptr), audio(nullptr), streamed(nullptr), stream(nullptr), sample(0), interpolation(init_interpolation), kernel(kResampleKernels[init_interpolation]), root_pitch(0.0), step_scale(0.0), position(kResampleTapsBefore), window(kResampleBlock * kMaxResampleRatio + kResampleTapsBefore + kResampleTapsAfter + 2, 0.0), window_fill(kResampleTapsBefore), positions(kResampleBlock) {}
+
+// A copy plays the same sample but needs a stream of its own, and takes
+// its own version of an in-memory sample on its first reset.
+Audio::Audio(const Audio& other) : Oscillator(other), slot(other.slot), audio(nullptr), streamed(other.streamed), stream(other.stream ? new SampleStream(other.streamed) : nullptr), sample(0), interpolation(other.interpolation), kernel(other.kernel), root_pitch(other.root_pitch), step_scale(0.0), position(kResampleTapsBefore), window(other.window.size(), 0.0), window_fill(kResampleTapsBefore), positions(kResampleBlock) {}
+
+// Takes effect from the next reset. A streamed sample needs the stream to
+// have been made already. A root pitch of 0 means the sample's own.
+void Audio::select(SampleSlot* new_slot, StreamedSample* new_streamed, float new_root_pitch) {
+  slot = new_slot;
+  streamed = new_streamed;
+  root_pitch = new_root_pitch;
+}
+
+Audio::~Audio() {
+  if (audio) audio->release();
+  delete stream;
+}
+
+// Appends count frames to the window, going round to the start at the end
+// of an in-memory sample.
+void Audio::fetch(int count) {
+  float* out = window.data() + window_fill;
+  window_fill += count;
+  if (streamed) {
+    for (int i=0; i < count; ++i) out[i] = stream->next();
+    return;
+  }
+  if (!audio || audio->getLength() == 0) {
+    std::fill(out, out + count, 0.0f);
+    return;
+  }
+  const float* frames = audio->getFrames();
+  long length = audio->getLength();
+  while (count > 0) {
+    int stretch = std::min<long>(count, length - sample);
+    std::copy(frames + sample, frames + sample + stretch, out);
+    out += stretch;
+    count -= stretch;
+    sample += stretch;
+    if (sample == length) sample = 0;
+  }
+}
+
+// Works out the read positions for a block, fetches frames into the window
+// up to the taps the last of them needs, interpolates, and then drops the
+// frames the next block can no longer reach. Phase steps come from the
+// array if there is one, else the single phase_step is used throughout.
+void Audio::resample(const float* phase_steps, float phase_step, float* out, int length) {
+  for (int done=0; done < length; done += kResampleBlock) {
+    int count = std::min(length - done, static_cast<int>(kResampleBlock));
+    float largest_step = 0.0;
+    for (int i=0; i < count; ++i) {
+      positions[i] = position;
+      float step = (phase_steps ? phase_steps[done + i] : phase_step) * step_scale;
+      step = std::min(std::max(step, 0.0f), static_cast<float>(kMaxResampleRatio));
+      largest_step = std::max(largest_step, step);
+      position += step;
+    }
+    int needed = static_cast<int>(position) + kResampleTapsAfter + 1;
+    if (window_fill < needed) fetch(needed - window_fill);
+    kernel(window.data(), positions.data(), out + done, count, largest_step);
+    int spent = static_cast<int>(position) - kResampleTapsBefore;
+    std::copy(window.begin() + spent, window.begin() + window_fill, window.begin());
+    window_fill -= spent;
+    position -= spent;
+  }
 }
 
 float Audio::getAmplitude(float phase_step) {
+  if (interpolation != INTERPOLATION_NONE) {
+    float value;
+    resample(nullptr, phase_step, &value, 1);
+    return value;
+  }
+  if (streamed) return stream->next();
+  if (!audio) return 0.0;
   return audio->getAmplitude(sample++);
 }
 
+void Audio::render(const float* phase_steps, float* out, int length) {
+  if (interpolation != INTERPOLATION_NONE) resample(phase_steps, 0.0, out, length);
+  else Oscillator::render(phase_steps, out, length);
+}
+
+void Audio::renderSteady(float phase_step, float* out, int length) {
+  if (interpolation != INTERPOLATION_NONE) resample(nullptr, phase_step, out, length);
+  else Oscillator::renderSteady(phase_step, out, length);
+}
+
+// A voice that has gone quiet stops counting as a user of its version, so
+// a version replaced by a reload can be freed without waiting for the
+// voice to play another note.
+void Audio::stop() {
+  if (audio) audio->release();
+  audio = nullptr;
+}
+
+// The window starts with silence before the first frame, for the taps
+// that reach back past it.
 void Audio::reset() {
+  Sample* current = streamed || !slot ? nullptr : slot->acquire();
+  if (audio) audio->release();
+  audio = current;
+  if (streamed) stream->restart(streamed);
+  int sample_rate = streamed ? streamed->getSampleRate() : audio ? audio->getSampleRate() : 0;
+  float root = root_pitch > 0.0f ? root_pitch : streamed ? streamed->getPitch() : audio ? audio->getPitch() : 1.0f;
+  // A phase step is the note's frequency over the output rate, so this
+  // turns it into source frames per output frame.
+  step_scale = sample_rate / root;
   sample = 0;
+  std::fill(window.begin(), window.begin() + kResampleTapsBefore, 0.0f);
+  window_fill = kResampleTapsBefore;
+  position = kResampleTapsBefore;
+}
+
+
+Sampler::Sampler(Keymap* init_keymap, Interpolation init_interpolation) : Audio(init_interpolation, "Sampler"), keymap(init_keymap) {
+  if (keymap && keymap->hasStreamedZones()) stream = new SampleStream(nullptr);
+}
+
+// Velocity comes in scaled to [0, 1] and goes back to a MIDI number for the
+// keymap.
+void Sampler::trigger(int note, float velocity) {
+  int midi_velocity = std::min(std::max(static_cast<int>(velocity * 127.0f + 0.5f), 0), Keymap::kVelocities - 1);
+  const SampleZone* zone = keymap ? keymap->next(note, midi_velocity) : nullptr;
+  if (zone) select(zone->slot, zone->streamed, zone->root_pitch);
+  else select(nullptr, nullptr, 0.0);
+  reset();
 }
@@ -1,22 +1,37 @@
 #ifndef JACK_MIDI_SYNTH_OSCILLATORS_H
 #define JACK_MIDI_SYNTH_OSCILLATORS_H
 
-#include <random>
 #include <cmath>
+#include <cstdint>
+#include <vector>
 
+#include "jack_midi_synth_kernels.h"
 #include "jack_midi_synth_sample.h"
 
+class Keymap;
+class SampleStream;
+class Wavetable;
+
 
 class Oscillator {
   protected:
     float offset;
   public:
     Oscillator(const char* init_type) : offset(0.0), type(init_type) {}
+    virtual ~Oscillator() {}
     virtual float getAmplitude(float) = 0;
+    virtual void render(const float*, float*, int);
+    virtual void renderSteady(float, float*, int);
     virtual void setFloatParameter(int, float) {}
     virtual void setIntParameter(int, int) {}
     virtual void setBoolParameter(int, bool) {}
     virtual void reset() { offset = 0.0; }
+    // Called on each note on. Oscillators that depend on more of the note
+    // than its pitch override it.
+    virtual void trigger(int, float) { reset(); }
+    // Called once the voice has gone quiet, to let go of anything shared
+    // with other voices until the next trigger.
+    virtual void stop() {}
     const char* type;
 };
 
@@ -34,6 +49,11 @@ class PitchedOscillator : public Oscillator {
     PitchedOscillator(float tune, const char* init_type) : Oscillator(init_type), pulse_centre(0.5), tuning(pow(2.0, tune)) {}
     virtual float advanceOffset(float);
     virtual float pulseWidthModulate(float);
+    void advanceOffsets(const float*, float*, int);
+    void advanceOffsets(float, float*, int);
+    virtual void shape(const float*, float*, int) = 0;
+    virtual void render(const float*, float*, int) override;
+    virtual void renderSteady(float, float*, int) override;
     virtual void setFloatParameter(int, float);
 };
 
@@ -42,6 +62,7 @@ class Sine : public PitchedOscillator {
   public:
     Sine(float tune=0.0) : PitchedOscillator(tune, "Sine") {}
     virtual float getAmplitude(float) override;
+    virtual void shape(const float*, float*, int) override;
 };
 
 
@@ -49,6 +70,7 @@ class Pulse : public PitchedOscillator {
   public:
     Pulse(float tune=0.0) : PitchedOscillator(tune, "Pulse") {}
     virtual float getAmplitude(float) override;
+    virtual void shape(const float*, float*, int) override;
 };
 
 
@@ -56,6 +78,7 @@ class Triangle : public PitchedOscillator {
   public:
     Triangle(float tune=0.0) : PitchedOscillator(tune, "Triangle") {}
     virtual float getAmplitude(float) override;
+    virtual void shape(const float*, float*, int) override;
 };
 
 
@@ -63,6 +86,7 @@ class Saw : public PitchedOscillator {
   public:
     Saw(float tune=0.0) : PitchedOscillator(tune, "Saw") {}
     virtual float getAmplitude(float) override;
+    virtual void shape(const float*, float*, int) override;
 };
 
 
@@ -70,26 +94,104 @@ class ReverseSaw : public PitchedOscillator {
   public:
     ReverseSaw(float tune=0.0) : PitchedOscillator(tune, "ReverseSaw") {}
     virtual float getAmplitude(float) override;
+    virtual void shape(const float*, float*, int) override;
+};
+
+
+// Reads a band-limited Wavetable instead of computing the shape. The level
+// is chosen once per block from the fastest phase step in it, so the
+// whole block is free of aliasing and the per-sample work is two table
+// reads and a lerp.
+class WavetableOscillator : public PitchedOscillator {
+  private:
+    const Wavetable* table;
+    int level;
+  public:
+    WavetableOscillator(const Wavetable*, float=0.0);
+    virtual float getAmplitude(float) override;
+    virtual void shape(const float*, float*, int) override;
+    virtual void render(const float*, float*, int) override;
+    virtual void renderSteady(float, float*, int) override;
 };
 
 
 class Noise : public Oscillator {
   private:
-    std::default_random_engine generator;
-    std::uniform_real_distribution<float> distribution;
+    uint32_t states[kNoiseLanes];
   public:
-    Noise() : distribution(-1.0, 1.0), Oscillator("Noise") {}
+    Noise();
     virtual float getAmplitude(float) override;
+    virtual void render(const float*, float*, int) override;
+    virtual void renderSteady(float, float*, int) override;
 };
 
+// Plays a sample file from its start. With no interpolation it plays one
+// frame per frame whatever the note. Otherwise it plays at the note's
+// pitch (bend included) relative to the root pitch, which is the
+// sample's own unless the patch gives one, reading a fractional position
+// through one of the resampling kernels kResampleBlock frames at a time.
+// The frames around the read position are kept in a window, so the
+// kernels read them contiguously whether they come from memory, going
+// round at the end of the sample, or from the disk. A file the
+// SampleManager streams is read through a SampleStream of this
+// oscillator's own instead of from memory. An in-memory file is played
+// through its SampleSlot: each reset takes whichever version was
+// published last, so a reloaded file is heard from the next note on and
+// the oscillator is silent until the first version has loaded.
 class Audio : public Oscillator {
-  private:
+  public:
+    enum Interpolation {
+      INTERPOLATION_NONE = 0,
+      INTERPOLATION_LINEAR,
+      INTERPOLATION_CUBIC,
+      INTERPOLATION_SINC,
+      kNumInterpolations
+    };
+    static const int kResampleBlock = 64;
+    static const int kMaxResampleRatio = 16;
+  protected:
+    SampleSlot* slot;
     Sample* audio;
+    StreamedSample* streamed;
+    SampleStream* stream;
+  private:
     int sample;
+    Interpolation interpolation;
+    void (*kernel)(const float*, const float*, float*, int, float);
+    float root_pitch;
+    float step_scale;
+    double position;
+    std::vector<float> window;
+    int window_fill;
+    std::vector<float> positions;
+    void fetch(int);
+    void resample(const float*, float, float*, int);
+  protected:
+    Audio(Interpolation, const char*);
+    void select(SampleSlot*, StreamedSample*, float);
   public:
-    Audio(const char*, float=261.2);
+    Audio(const char*, Interpolation=INTERPOLATION_NONE, float=0.0);
+    Audio(const Audio&);
+    Audio& operator=(const Audio&) = delete;
+    ~Audio();
     virtual float getAmplitude(float) override;
+    virtual void render(const float*, float*, int) override;
+    virtual void renderSteady(float, float*, int) override;
     virtual void reset() override;
+    virtual void stop() override;
+};
+
+
+// Plays whichever zone of a Keymap the note and velocity select, taking
+// turns through round-robin zones, at the note's pitch relative to the
+// zone's root key. One stream serves every streamed zone, since a voice
+// only plays one zone at a time.
+class Sampler : public Audio {
+  private:
+    Keymap* keymap;
+  public:
+    Sampler(Keymap*, Interpolation=INTERPOLATION_CUBIC);
+    virtual void trigger(int, float) override;
 };
 
 #endif // JACK_MIDI_SYNTH_OSCILLATORS_H
@@ -0,0 +1,369 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#include "jack_midi_synth_patch.h"
+#include "jack_midi_synth_convolution.h"
+#include "jack_midi_synth_envelopes.h"
+#include "jack_midi_synth_filters.h"
+#include "jack_midi_synth_oscillators.h"
+#include "jack_midi_synth_sample_manager.h"
+#include "jack_midi_synth_wavetable.h"
+
+
+// Voice's original hard-coded sound, with its delay moved onto the effect
+// bus.
+const char* kDefaultPatch =
+  "envelope ladsr 0.06 0.25 0.9 1.5 0.01\n"
+  "oscillator audio test.wav 0.8 ladsr 0.1 0.5 0.9 3.0\n"                   // Sample
+  "oscillator sine 2.0 0.2 ladsr 0.06 0.15 0.8 1.0 0.015\n"                 // Sub
+  "oscillator triangle -1.0 0.1 ladsr 0.06 0.2 0.65 0.9 0.015\n"            // Sub fifth
+  "oscillator triangle 0.0 0.7 ladsr 0.05 0.25 0.5 0.8 0.02\n"              // Main
+  "oscillator sine 0.58333333333 0.3 ladsr 0.04 0.2 0.7 0.7 0.02\n"         // Fifth
+  "oscillator sine 1.0 0.4 ladsr 0.03 0.15 0.4 0.6 0.02\n"                  // Octave
+  "oscillator pulse 2.0 0.05 ladsr 0.02 0.1 0.3 0.5 0.02\n"                 // Octave 2
+  "filter pass\n"
+  "effect delay 0.1 0.7\n";
+
+struct PatchWord {
+  const char* name;
+  PatchOp::Type type;
+  int min_parameters;
+  int max_parameters;
+};
+
+// Envelopes are stored with every optional argument filled in and the
+// shape last, so newEnvelope can pass the slots straight through.
+const PatchWord kEnvelopeWords[] = {
+  {"constant", PatchOp::ENVELOPE_CONSTANT, 1, 1},
+  {"lad", PatchOp::ENVELOPE_LAD, 2, 3},
+  {"ladsr", PatchOp::ENVELOPE_LADSR, 4, 5},
+  {"dl4r4", PatchOp::ENVELOPE_DL4R4, 8, 9}
+};
+
+const PatchWord kOscillatorWords[] = {
+  {"sine", PatchOp::OSCILLATOR_SINE, 1, 1},
+  {"pulse", PatchOp::OSCILLATOR_PULSE, 1, 1},
+  {"triangle", PatchOp::OSCILLATOR_TRIANGLE, 1, 1},
+  {"saw", PatchOp::OSCILLATOR_SAW, 1, 1},
+  {"reversesaw", PatchOp::OSCILLATOR_REVERSE_SAW, 1, 1},
+  {"noise", PatchOp::OSCILLATOR_NOISE, 0, 0},
+  {"audio", PatchOp::OSCILLATOR_AUDIO, 0, 0},
+  {"wavetable", PatchOp::OSCILLATOR_WAVETABLE, 1, 1},
+  {"sampler", PatchOp::OSCILLATOR_SAMPLER, 0, 0}
+};
+
+const char* kWavetableShapes[Wavetable::kNumShapes] = {"sine", "triangle", "saw", "reversesaw", "pulse"};
+
+// The built-in shape a wavetable oscillator names, or -1 for a file.
+int findWavetableShape(const std::string& name) {
+  for (int shape=0; shape < Wavetable::kNumShapes; ++shape) {
+    if (name == kWavetableShapes[shape]) return shape;
+  }
+  return -1;
+}
+
+const char* kInterpolations[Audio::kNumInterpolations] = {"none", "linear", "cubic", "sinc"};
+
+const char* kFilterModes[Pass::kNumFilterModes] = {"lowpass", "highpass", "bandpass", "notch"};
+
+template <int N>
+const PatchWord* findWord(const PatchWord (&words)[N], const std::string& name) {
+  for (int i=0; i < N; ++i) {
+    if (name == words[i].name) return &words[i];
+  }
+  return nullptr;
+}
+
+bool parseNumber(const std::string& token, float& value) {
+  char* end;
+  value = strtof(token.c_str(), &end);
+  return !token.empty() && *end == '\0';
+}
+
+
+const char* Patch::parseEnvelope(const std::vector<std::string>& tokens, int first) {
+  if (first >= tokens.size()) return "missing envelope";
+  const PatchWord* word = findWord(kEnvelopeWords, tokens[first]);
+  if (!word) return "unknown envelope type";
+  int parameter = parameters.size();
+  int next = first + 1;
+  float value;
+  while (next < tokens.size() && parseNumber(tokens[next], value)) {
+    parameters.push_back(value);
+    ++next;
+  }
+  int count = parameters.size() - parameter;
+  if (count < word->min_parameters || count > word->max_parameters) return "wrong number of envelope parameters";
+  parameters.resize(parameter + word->max_parameters, 0.0);
+  if (word->type != PatchOp::ENVELOPE_CONSTANT) {
+    SegmentEnvelope::Shape shape = SegmentEnvelope::SHAPE_LINEAR;
+    if (next < tokens.size() && tokens[next] == "exponential") {
+      shape = SegmentEnvelope::SHAPE_EXPONENTIAL;
+      ++next;
+    } else if (next < tokens.size() && tokens[next] == "linear") {
+      ++next;
+    }
+    parameters.push_back(shape);
+  }
+  if (next != tokens.size()) return "unexpected words after envelope";
+  ops.push_back(PatchOp(PatchOp::OP_ENVELOPE, word->type, parameter, parameters.size() - parameter));
+  return nullptr;
+}
+
+const char* Patch::parseOscillator(const std::vector<std::string>& tokens) {
+  if (tokens.size() < 2) return "missing oscillator type";
+  const PatchWord* word = findWord(kOscillatorWords, tokens[1]);
+  if (!word) return "unknown oscillator type";
+  int next = 2;
+  int file = -1;
+  bool sampled = word->type == PatchOp::OSCILLATOR_AUDIO || word->type == PatchOp::OSCILLATOR_SAMPLER;
+  if (sampled || word->type == PatchOp::OSCILLATOR_WAVETABLE) {
+    if (next >= tokens.size()) return word->type == PatchOp::OSCILLATOR_AUDIO ? "missing audio file" : word->type == PatchOp::OSCILLATOR_SAMPLER ? "missing keymap" : "missing wavetable";
+    file = filenames.size();
+    filenames.push_back(tokens[next++]);
+  }
+  if (word->type == PatchOp::OSCILLATOR_SAMPLER && !SampleManager::get().getKeymap(filenames[file].c_str())) return "unable to load keymap";
+  if (word->type == PatchOp::OSCILLATOR_WAVETABLE && findWavetableShape(filenames[file]) < 0 && !SampleManager::get().getWavetable(filenames[file].c_str())) return "unable to load wavetable";
+  // Audio and sampler may name an interpolation, and audio after it a
+  // root pitch, between the file and the mix. They are stored after the
+  // mix, a root of 0 meaning the sample's own.
+  float value;
+  int interpolation = word->type == PatchOp::OSCILLATOR_SAMPLER ? Audio::INTERPOLATION_CUBIC : Audio::INTERPOLATION_NONE;
+  float root = 0.0;
+  if (sampled && next < tokens.size() && !parseNumber(tokens[next], value)) {
+    for (interpolation=0; interpolation < Audio::kNumInterpolations; ++interpolation) {
+      if (tokens[next] == kInterpolations[interpolation]) break;
+    }
+    if (interpolation == Audio::kNumInterpolations) return "unknown interpolation";
+    ++next;
+    if (word->type == PatchOp::OSCILLATOR_AUDIO && next + 1 < tokens.size() && parseNumber(tokens[next], root) && parseNumber(tokens[next + 1], value)) {
+      if (root <= 0.0) return "root pitch must be positive";
+      ++next;
+    } else {
+      root = 0.0;
+    }
+  }
+  int parameter = parameters.size();
+  for (int i=0; i < word->max_parameters + 1; ++i) {
+    if (next >= tokens.size() || !parseNumber(tokens[next++], value)) return word->max_parameters ? "expected tuning and mix" : "expected mix";
+    parameters.push_back(value);
+  }
+  // The mix goes first whatever the order on the line.
+  std::swap(parameters[parameter], parameters.back());
+  if (sampled) {
+    parameters.push_back(interpolation);
+    parameters.push_back(root);
+  }
+  ops.push_back(PatchOp(PatchOp::OP_OSCILLATOR, word->type, parameter, parameters.size() - parameter, file));
+  return parseEnvelope(tokens, next);
+}
+
+const char* Patch::parseFilter(const std::vector<std::string>& tokens, PatchOp::Code code) {
+  if (tokens.size() < 2) return "missing filter type";
+  int parameter = parameters.size();
+  if (tokens[1] == "pass") {
+    int mode = Pass::FILTER_MODE_LOWPASS;
+    float order = 2;
+    int next = 2;
+    if (next < tokens.size()) {
+      for (mode=0; mode < Pass::kNumFilterModes; ++mode) {
+        if (tokens[next] == kFilterModes[mode]) break;
+      }
+      if (mode == Pass::kNumFilterModes) return "unknown filter mode";
+      ++next;
+    }
+    if (next < tokens.size() && (!parseNumber(tokens[next++], order) || order < 1)) return "expected filter order";
+    if (next != tokens.size()) return "unexpected words after filter";
+    parameters.push_back(mode);
+    parameters.push_back(order);
+    ops.push_back(PatchOp(code, PatchOp::FILTER_PASS, parameter, 2));
+  } else if (tokens[1] == "svf") {
+    int mode = Pass::FILTER_MODE_LOWPASS;
+    float cutoff = 0.5;
+    float resonance = 0.0;
+    float amount = 0.0;
+    int next = 2;
+    if (next < tokens.size() && !parseNumber(tokens[next], cutoff)) {
+      for (mode=0; mode < Pass::kNumFilterModes; ++mode) {
+        if (tokens[next] == kFilterModes[mode]) break;
+      }
+      if (mode == Pass::kNumFilterModes) return "unknown filter mode";
+      ++next;
+    }
+    if (next < tokens.size() && !parseNumber(tokens[next++], cutoff)) return "expected filter cutoff";
+    if (next < tokens.size() && !parseNumber(tokens[next++], resonance)) return "expected filter resonance";
+    bool swept = next < tokens.size();
+    if (swept && !parseNumber(tokens[next++], amount)) return "expected envelope amount";
+    parameters.push_back(mode);
+    parameters.push_back(cutoff);
+    parameters.push_back(resonance);
+    parameters.push_back(amount);
+    ops.push_back(PatchOp(code, PatchOp::FILTER_STATE_VARIABLE, parameter, 4));
+    if (swept && code == PatchOp::OP_EFFECT) return "an effect takes no envelope";
+    if (swept) return parseEnvelope(tokens, next);
+  } else if (tokens[1] == "reverb") {
+    float wet = 0.3;
+    if (code != PatchOp::OP_EFFECT) return "reverb only runs as an effect";
+    if (tokens.size() < 3) return "missing impulse response";
+    if (tokens.size() > 4) return "unexpected words after effect";
+    if (tokens.size() > 3 && !parseNumber(tokens[3], wet)) return "expected wet level";
+    int file = filenames.size();
+    filenames.push_back(tokens[2]);
+    if (SampleManager::get().getSample(filenames[file].c_str())->getLength() == 0) return "unable to load impulse response";
+    parameters.push_back(wet);
+    ops.push_back(PatchOp(code, PatchOp::FILTER_CONVOLUTION, parameter, 1, file));
+  } else if (tokens[1] == "delay") {
+    float delay = 0.3;
+    float feedback = 0.6;
+    if (tokens.size() > 4) return "unexpected words after filter";
+    if (tokens.size() > 2 && (!parseNumber(tokens[2], delay) || delay <= 0.0)) return "expected delay time";
+    if (tokens.size() > 3 && !parseNumber(tokens[3], feedback)) return "expected delay feedback";
+    parameters.push_back(delay);
+    parameters.push_back(feedback);
+    ops.push_back(PatchOp(code, PatchOp::FILTER_DELAY, parameter, 2));
+  } else {
+    return "unknown filter type";
+  }
+  return nullptr;
+}
+
+bool Patch::parse(std::istream& in, const char* name) {
+  ops.clear();
+  parameters.clear();
+  filenames.clear();
+  send_level = 1.0;
+  int amp = -1;
+  std::string line;
+  for (int line_number=1; std::getline(in, line); ++line_number) {
+    std::istringstream words(line);
+    std::vector<std::string> tokens;
+    std::string token;
+    while (words >> token && token[0] != '#') tokens.push_back(token);
+    if (tokens.empty()) continue;
+    const char* error = nullptr;
+    if (tokens[0] == "envelope") {
+      if (amp >= 0) {
+        error = "more than one amp envelope";
+      } else {
+        amp = ops.size();
+        error = parseEnvelope(tokens, 1);
+      }
+    } else if (tokens[0] == "oscillator") {
+      error = parseOscillator(tokens);
+    } else if (tokens[0] == "filter") {
+      error = parseFilter(tokens, PatchOp::OP_FILTER);
+    } else if (tokens[0] == "effect") {
+      error = parseFilter(tokens, PatchOp::OP_EFFECT);
+    } else if (tokens[0] == "send") {
+      if (tokens.size() != 2 || !parseNumber(tokens[1], send_level) || send_level < 0.0 || send_level > 1.0) error = "expected a send level from 0 to 1";
+    } else {
+      error = "expected envelope, oscillator, filter, effect or send";
+    }
+    if (error) {
+      std::cerr << name << ":" << line_number << ": " << error << std::endl;
+      return false;
+    }
+  }
+  if (amp < 0) {
+    std::cerr << name << ": no amp envelope" << std::endl;
+    return false;
+  }
+  // Keep the amp envelope first so a voice can take it before the slots.
+  PatchOp amp_op = ops[amp];
+  ops.erase(ops.begin() + amp);
+  ops.insert(ops.begin(), amp_op);
+  return true;
+}
+
+bool Patch::load(const char* filename) {
+  std::ifstream in(filename);
+  if (!in) {
+    std::cerr << "Unable to open " << filename << std::endl;
+    return false;
+  }
+  return parse(in, filename);
+}
+
+// A patch without effects has nothing to send to.
+float Patch::getSendLevel() const {
+  for (auto& op: ops) {
+    if (op.code == PatchOp::OP_EFFECT) return send_level;
+  }
+  return 0.0;
+}
+
+Envelope* Patch::newEnvelope(const PatchOp& op) const {
+  const float* p = parameters.data() + op.parameter;
+  SegmentEnvelope::Shape shape = static_cast<SegmentEnvelope::Shape>(static_cast<int>(p[op.count - 1]));
+  switch (op.type) {
+    case PatchOp::ENVELOPE_CONSTANT:
+      return new Constant(p[0]);
+    case PatchOp::ENVELOPE_LAD:
+      return new LAD(p[0], p[1], p[2], shape);
+    case PatchOp::ENVELOPE_LADSR:
+      return new LADSR(p[0], p[1], p[2], p[3], p[4], shape);
+    case PatchOp::ENVELOPE_DL4R4:
+      return new DL4R4(p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7], p[8], shape);
+    default:
+      return nullptr;
+  }
+}
+
+Oscillator* Patch::newOscillator(const PatchOp& op) const {
+  const float* p = parameters.data() + op.parameter;
+  switch (op.type) {
+    case PatchOp::OSCILLATOR_SINE:
+      return new Sine(p[1]);
+    case PatchOp::OSCILLATOR_PULSE:
+      return new Pulse(p[1]);
+    case PatchOp::OSCILLATOR_TRIANGLE:
+      return new Triangle(p[1]);
+    case PatchOp::OSCILLATOR_SAW:
+      return new Saw(p[1]);
+    case PatchOp::OSCILLATOR_REVERSE_SAW:
+      return new ReverseSaw(p[1]);
+    case PatchOp::OSCILLATOR_NOISE:
+      return new Noise();
+    case PatchOp::OSCILLATOR_AUDIO:
+      return new Audio(filenames[op.file].c_str(), static_cast<Audio::Interpolation>(static_cast<int>(p[1])), p[2]);
+    case PatchOp::OSCILLATOR_SAMPLER:
+      return new Sampler(SampleManager::get().getKeymap(filenames[op.file].c_str()), static_cast<Audio::Interpolation>(static_cast<int>(p[1])));
+    case PatchOp::OSCILLATOR_WAVETABLE:
+      if (findWavetableShape(filenames[op.file]) >= 0) return new WavetableOscillator(&Wavetable::get(static_cast<Wavetable::Shape>(findWavetableShape(filenames[op.file]))), p[1]);
+      return new WavetableOscillator(SampleManager::get().getWavetable(filenames[op.file].c_str()), p[1]);
+    default:
+      return nullptr;
+  }
+}
+
+Filter* Patch::newFilter(const PatchOp& op) const {
+  const float* p = parameters.data() + op.parameter;
+  switch (op.type) {
+    case PatchOp::FILTER_PASS:
+      return new Pass(static_cast<Pass::FilterMode>(static_cast<int>(p[0])), static_cast<int>(p[1]));
+    case PatchOp::FILTER_STATE_VARIABLE:
+      return new StateVariable(static_cast<Pass::FilterMode>(static_cast<int>(p[0])), p[1], p[2]);
+    case PatchOp::FILTER_DELAY:
+      return new Delay(p[0], p[1]);
+    case PatchOp::FILTER_CONVOLUTION:
+      return new Convolution(SampleManager::get().getSample(filenames[op.file].c_str())->copyFrames(), p[0]);
+    default:
+      return nullptr;
+  }
+}
+
+Patch parseDefault() {
+  Patch patch;
+  std::istringstream in(kDefaultPatch);
+  patch.parse(in, "default patch");
+  return patch;
+}
+
+const Patch& Patch::getDefault() {
+  static const Patch instance(parseDefault());
+  return instance;
+}
@@ -0,0 +1,109 @@
+#ifndef JACK_MIDI_SYNTH_PATCH_H
+#define JACK_MIDI_SYNTH_PATCH_H
+
+#include <istream>
+#include <string>
+#include <vector>
+
+class Envelope;
+class Filter;
+class Oscillator;
+
+struct PatchOp {
+  enum Code {
+    OP_ENVELOPE = 0,
+    OP_OSCILLATOR,
+    OP_FILTER,
+    OP_EFFECT,
+    kNumCodes
+  };
+  enum Type {
+    ENVELOPE_CONSTANT = 0,
+    ENVELOPE_LAD,
+    ENVELOPE_LADSR,
+    ENVELOPE_DL4R4,
+    OSCILLATOR_SINE,
+    OSCILLATOR_PULSE,
+    OSCILLATOR_TRIANGLE,
+    OSCILLATOR_SAW,
+    OSCILLATOR_REVERSE_SAW,
+    OSCILLATOR_NOISE,
+    OSCILLATOR_AUDIO,
+    OSCILLATOR_WAVETABLE,
+    OSCILLATOR_SAMPLER,
+    FILTER_PASS,
+    FILTER_STATE_VARIABLE,
+    FILTER_DELAY,
+    FILTER_CONVOLUTION,
+    kNumTypes
+  };
+  PatchOp(Code init_code, Type init_type, int init_parameter, int init_count, int init_file=-1) : code(init_code), type(init_type), parameter(init_parameter), count(init_count), file(init_file) {}
+  Code code;
+  Type type;
+  int parameter;
+  int count;
+  int file;
+};
+
+// A patch compiled from its text description into one flat list of ops,
+// each pointing at a run of slots in a shared parameter array. The first
+// envelope op is the amp envelope; every oscillator op is followed by the
+// envelope op that shapes it and its mix is its first parameter. A filter
+// op may be followed by an envelope op sweeping its cutoff, by the amount
+// in its last parameter. Effect ops are filters that run once on the
+// send mix of every voice rather than in each voice. Loading
+// and parsing allocate, so they belong on a non-real-time thread; a Voice
+// is then built by walking the ops once.
+//
+//   # comment
+//   envelope ladsr 0.06 0.25 0.9 1.5 0.01
+//   oscillator sine 2.0 0.2 ladsr 0.06 0.15 0.8 1.0 0.015
+//   oscillator audio test.wav 0.8 ladsr 0.1 0.5 0.9 3.0
+//   oscillator audio piano_c4.wav cubic 261.6 0.8 ladsr 0.01 0.5 0.9 1.0
+//   oscillator sampler piano.keymap sinc 0.8 ladsr 0.01 0.5 0.9 1.0
+//   oscillator wavetable saw 0.0 0.5 lad 0.01 1.0
+//   filter pass lowpass 2
+//   filter svf bandpass 0.3 0.6 0.4 lad 0.005 0.4
+//   effect delay 0.1 0.7
+//   effect reverb hall.wav 0.3
+//   send 0.5
+//
+// Envelopes are constant, lad, ladsr or dl4r4 followed by their
+// constructor arguments and an optional linear or exponential. Pitched
+// oscillators take a tuning in octaves, noise takes nothing and audio
+// takes a WAV file, optionally followed by linear, cubic or sinc
+// interpolation to play it at the note's pitch and then optionally the
+// root pitch it was recorded at in Hz. A sampler takes a Keymap file and
+// optionally an interpolation, cubic by default, and is loaded with the
+// patch. Every oscillator then takes its mix and envelope. A
+// wavetable oscillator names a band-limited sine, triangle, saw,
+// reversesaw or pulse, or a single-cycle WAV file, before its tuning.
+// An svf filter takes an optional mode, then cutoff and resonance from 0
+// to 1, then optionally an envelope amount and the envelope. An effect
+// takes the same words as a filter, without the envelope, or reverb with
+// an impulse response WAV file and an optional wet level. Send sets
+// the share of each voice routed through the effects instead of straight
+// to the output, 1 by default.
+class Patch {
+  private:
+    std::vector<PatchOp> ops;
+    std::vector<float> parameters;
+    std::vector<std::string> filenames;
+    float send_level;
+    const char* parseEnvelope(const std::vector<std::string>&, int);
+    const char* parseOscillator(const std::vector<std::string>&);
+    const char* parseFilter(const std::vector<std::string>&, PatchOp::Code);
+  public:
+    Patch() : send_level(1.0) {}
+    bool parse(std::istream&, const char*);
+    bool load(const char*);
+    const std::vector<PatchOp>& getOps() const { return ops; }
+    float getParameter(const PatchOp& op, int index) const { return parameters[op.parameter + index]; }
+    float getSendLevel() const;
+    Envelope* newEnvelope(const PatchOp&) const;
+    Oscillator* newOscillator(const PatchOp&) const;
+    Filter* newFilter(const PatchOp&) const;
+    static const Patch& getDefault();
+};
+
+#endif // JACK_MIDI_SYNTH_PATCH_H
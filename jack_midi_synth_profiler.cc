@@ -0,0 +1,85 @@
+#include "jack_midi_synth_profiler.h"
+
+#ifdef JACK_MIDI_SYNTH_PROFILE
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+
+static const int kMaxSlotName = 48;
+static char slot_names[kNumProfileSlots][kMaxSlotName];
+
+
+Profiler::Profiler() : periods(0) {
+  for (int slot=0; slot < kNumProfileSlots; ++slot) {
+    ticks[slot] = 0;
+    calls[slot] = 0;
+    names[slot] = nullptr;
+  }
+  names[PROFILE_CONTROLLERS] = "controller interpolation";
+  names[PROFILE_ENVELOPES] = "envelopes";
+  names[PROFILE_VOICE_TANH] = "voice tanh";
+  names[PROFILE_MASTER_TANH] = "master tanh";
+  names[PROFILE_EFFECTS] = "effect bus";
+  start_ticks = now();
+  start_seconds = nowNanoseconds() * 1e-9;
+}
+
+Profiler& Profiler::get() {
+  static Profiler profiler;
+  return profiler;
+}
+
+uint64_t Profiler::nowNanoseconds() {
+  timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return static_cast<uint64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+// Names are registered once per slot by whoever builds the patch; voices
+// share the same patch layout so only the first registration sticks.
+void Profiler::setName(int slot, const char* prefix, const char* type) {
+  if (names[slot].load(std::memory_order_acquire)) return;
+  int index = slot >= PROFILE_FILTER ? slot - PROFILE_FILTER : slot - PROFILE_OSCILLATOR;
+  snprintf(slot_names[slot], kMaxSlotName, "%s %d (%s)", prefix, index, type);
+  names[slot].store(slot_names[slot], std::memory_order_release);
+}
+
+// The cycle counter is converted to time by comparing it against the
+// monotonic clock over the lifetime of the profiler.
+void Profiler::report(std::ostream& out) {
+  double elapsed_seconds = nowNanoseconds() * 1e-9 - start_seconds;
+  double elapsed_ticks = now() - start_ticks;
+  double us_per_tick = elapsed_ticks > 0 ? elapsed_seconds * 1e6 / elapsed_ticks : 0.0;
+  uint64_t period_count = std::max<uint64_t>(periods.load(std::memory_order_relaxed), 1);
+  std::vector<std::pair<uint64_t, int>> ranked;
+  uint64_t total = 0;
+  for (int slot=0; slot < kNumProfileSlots; ++slot) {
+    uint64_t slot_ticks = ticks[slot].load(std::memory_order_relaxed);
+    if (calls[slot].load(std::memory_order_relaxed) == 0) continue;
+    ranked.push_back(std::make_pair(slot_ticks, slot));
+    total += slot_ticks;
+  }
+  std::sort(ranked.rbegin(), ranked.rend());
+  char line[128];
+  snprintf(line, sizeof(line), "profile: %llu periods\n", static_cast<unsigned long long>(period_count));
+  out << line;
+  snprintf(line, sizeof(line), "  %-32s %12s %12s %7s\n", "stage", "us/period", "calls/period", "share");
+  out << line;
+  for (const auto& entry: ranked) {
+    int slot = entry.second;
+    const char* name = names[slot].load(std::memory_order_acquire);
+    snprintf(line, sizeof(line), "  %-32s %12.2f %12.1f %6.1f%%\n", name ? name : "unnamed",
+             entry.first * us_per_tick / period_count,
+             static_cast<double>(calls[slot].load(std::memory_order_relaxed)) / period_count,
+             total ? 100.0 * entry.first / total : 0.0);
+    out << line;
+  }
+  out.flush();
+}
+
+#endif // JACK_MIDI_SYNTH_PROFILE
@@ -0,0 +1,88 @@
+#ifndef JACK_MIDI_SYNTH_PROFILER_H
+#define JACK_MIDI_SYNTH_PROFILER_H
+
+// Per-stage cost attribution, compiled in only when JACK_MIDI_SYNTH_PROFILE
+// is defined. Each PROFILE_SCOPE reads the cycle counter on entry and exit
+// and adds the difference to a fixed slot, so the process thread never
+// allocates. Oscillators and filters get one slot per position in the
+// patch, so the report says which oscillator or filter is expensive.
+
+enum ProfileSlot {
+  PROFILE_CONTROLLERS,
+  PROFILE_ENVELOPES,
+  PROFILE_VOICE_TANH,
+  PROFILE_MASTER_TANH,
+  PROFILE_EFFECTS,
+  PROFILE_OSCILLATOR,
+  PROFILE_FILTER = PROFILE_OSCILLATOR + 16,
+  kNumProfileSlots = PROFILE_FILTER + 16
+};
+
+const int kMaxProfiledOscillators = PROFILE_FILTER - PROFILE_OSCILLATOR;
+const int kMaxProfiledFilters = kNumProfileSlots - PROFILE_FILTER;
+
+#ifdef JACK_MIDI_SYNTH_PROFILE
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+class Profiler {
+  private:
+    std::atomic<uint64_t> ticks[kNumProfileSlots];
+    std::atomic<uint64_t> calls[kNumProfileSlots];
+    std::atomic<uint64_t> periods;
+    std::atomic<const char*> names[kNumProfileSlots];
+    uint64_t start_ticks;
+    double start_seconds;
+    Profiler();
+  public:
+    static Profiler& get();
+    static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+      return __rdtsc();
+#else
+      return nowNanoseconds();
+#endif
+    }
+    static uint64_t nowNanoseconds();
+    void add(int slot, uint64_t elapsed) {
+      ticks[slot].fetch_add(elapsed, std::memory_order_relaxed);
+      calls[slot].fetch_add(1, std::memory_order_relaxed);
+    }
+    void addPeriod() { periods.fetch_add(1, std::memory_order_relaxed); }
+    void setName(int, const char*, const char*);
+    void report(std::ostream&);
+};
+
+
+class ProfileScope {
+  private:
+    int slot;
+    uint64_t start;
+  public:
+    ProfileScope(int init_slot) : slot(init_slot), start(Profiler::now()) {}
+    ~ProfileScope() { Profiler::get().add(slot, Profiler::now() - start); }
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(slot) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(slot)
+#define PROFILE_NAME(slot, prefix, type) Profiler::get().setName(slot, prefix, type)
+#define PROFILE_PERIOD() Profiler::get().addPeriod()
+#define PROFILE_REPORT(out) Profiler::get().report(out)
+
+#else
+
+#define PROFILE_SCOPE(slot) (void)(slot)
+#define PROFILE_NAME(slot, prefix, type)
+#define PROFILE_PERIOD()
+#define PROFILE_REPORT(out)
+
+#endif // JACK_MIDI_SYNTH_PROFILE
+
+#endif // JACK_MIDI_SYNTH_PROFILER_H
@@ -0,0 +1,93 @@
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "jack_midi_synth_disk_streamer.h"
+#include "jack_midi_synth_logic.h"
+#include "jack_midi_synth_offline.h"
+#include "jack_midi_synth_sample_manager.h"
+#include "jack_midi_synth_telemetry.h"
+
+void usage(const char* name) {
+  std::cerr << "Usage: " << name << " [-r sample_rate] [-b block_size] [-l tail_seconds] [-p polyphony] [-s oldest|quietest|same] [-t render_threads] [-e voices|soa] [-P patch_file] [-B bank_file] [-d preload_ms] [-c cache_dir] [-o stats_file] input.mid output.wav" << std::endl;
+  exit(1);
+}
+
+int main(int argc, char *argv[]) {
+  int sample_rate = 48000;
+  int block_size = 256;
+  float tail = 2.0;
+  int polyphony = 32;
+  VoicePool::StealPolicy steal_policy = VoicePool::STEAL_OLDEST;
+  int render_threads = 0;
+  bool soa = false;
+  const char* stats_filename = nullptr;
+  const char* patch_filename = nullptr;
+  const char* bank_filename = nullptr;
+  float preload = 0.0;
+  const char* cache_directory = nullptr;
+  int option;
+  while ((option = getopt(argc, argv, "r:b:l:p:s:t:o:e:P:B:d:c:")) != -1) {
+    if (option == 'r') {
+      sample_rate = atoi(optarg);
+    } else if (option == 'b') {
+      block_size = atoi(optarg);
+    } else if (option == 'l') {
+      tail = atof(optarg);
+    } else if (option == 'p') {
+      polyphony = atoi(optarg);
+    } else if (option == 't') {
+      render_threads = atoi(optarg);
+    } else if (option == 'o') {
+      stats_filename = optarg;
+    } else if (option == 'P') {
+      patch_filename = optarg;
+    } else if (option == 'B') {
+      bank_filename = optarg;
+    } else if (option == 'd') {
+      preload = atof(optarg);
+    } else if (option == 'c') {
+      cache_directory = optarg;
+    } else if (option == 'e' && strcmp(optarg, "voices") == 0) {
+      soa = false;
+    } else if (option == 'e' && strcmp(optarg, "soa") == 0) {
+      soa = true;
+    } else if (option == 's' && strcmp(optarg, "oldest") == 0) {
+      steal_policy = VoicePool::STEAL_OLDEST;
+    } else if (option == 's' && strcmp(optarg, "quietest") == 0) {
+      steal_policy = VoicePool::STEAL_QUIETEST;
+    } else if (option == 's' && strcmp(optarg, "same") == 0) {
+      steal_policy = VoicePool::STEAL_SAME_NOTE;
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (argc - optind != 2 || sample_rate <= 0 || block_size <= 0) usage(argv[0]);
+  // Samples longer than the preload stream from disk. Rendering runs
+  // faster than real time, so it waits for the disk rather than underrun.
+  SampleManager::get().setPreload(preload);
+  // Decoded samples are kept in the cache directory and mapped on later
+  // starts.
+  if (cache_directory && !SampleManager::get().setCacheDirectory(cache_directory)) exit(1);
+  if (preload > 0.0) DiskStreamer::get().setBlocking(true);
+  JackSynth synth(polyphony, steal_policy, render_threads, soa);
+  if (bank_filename && !synth.loadBank(bank_filename)) exit(1);
+  if (patch_filename && !synth.loadPatch(patch_filename)) exit(1);
+  OfflineApp my_app(&synth, argv[optind], argv[optind + 1], sample_rate, block_size, tail);
+  Telemetry telemetry;
+  std::ofstream stats_file;
+  if (stats_filename) {
+    stats_file.open(stats_filename, std::ios::app);
+    if (!stats_file) {
+      std::cerr << "Unable to open " << stats_filename << std::endl;
+      exit(1);
+    }
+  }
+  my_app.setTelemetry(&telemetry, stats_filename ? &stats_file : &std::cerr);
+  my_app.activate();
+  my_app.run();
+  return 0;
+}
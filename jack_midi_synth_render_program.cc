@@ -0,0 +1,51 @@
+#include "jack_midi_synth_render_program.h"
+
+#include "jack_midi_synth_patch.h"
+#include "jack_midi_synth_voice.h"
+#include "jack_midi_synth_static_voice.h"
+
+
+RenderProgram::RenderProgram(const Patch& patch, int polyphony) : effects(patch), listed(false) {
+  if (polyphony < 1) polyphony = 1;
+  voices.reserve(polyphony);
+  free_voices.reserve(polyphony);
+  sounding.reserve(polyphony);
+  for (int i=0; i < polyphony; ++i) {
+#ifdef JACK_MIDI_SYNTH_STATIC_VOICE
+    if (&patch == &Patch::getDefault()) voices.push_back(newDefaultStaticVoice());
+    else voices.push_back(new Voice(patch));
+#else
+    voices.push_back(new Voice(patch));
+#endif
+    voices.back()->setSendLevel(patch.getSendLevel());
+    free_voices.push_back(voices.back());
+  }
+}
+
+RenderProgram::~RenderProgram() {
+  for (auto voice: voices) delete voice;
+}
+
+VoiceBase* RenderProgram::acquire() {
+  if (free_voices.empty()) return nullptr;
+  VoiceBase* voice = free_voices.back();
+  free_voices.pop_back();
+  return voice;
+}
+
+// Whether it finished or was stolen, the voice stops holding on to the
+// samples it was playing.
+void RenderProgram::release(VoiceBase* voice) {
+  voice->stopVoice();
+  free_voices.push_back(voice);
+}
+
+void RenderProgram::setSampleRate(int rate) {
+  for (auto voice: voices) voice->setSampleRate(rate);
+  effects.setSampleRate(rate);
+}
+
+void RenderProgram::setBufferSize(int size) {
+  for (auto voice: voices) voice->setBufferSize(size);
+  effects.setBufferSize(size);
+}
@@ -0,0 +1,44 @@
+#ifndef JACK_MIDI_SYNTH_RENDER_PROGRAM_H
+#define JACK_MIDI_SYNTH_RENDER_PROGRAM_H
+
+#include <vector>
+
+#include "jack_midi_synth_effect_bus.h"
+
+class Patch;
+class VoiceBase;
+
+// Every voice one patch can sound, built up front. Programs are compiled
+// off the process thread (their voices allocate, load samples and size
+// their delay lines) and handed to the VoicePool whole, after which
+// acquire and release only move pointers on a reserved free list. The
+// program's effect bus is built alongside its voices, and each period the
+// process thread lists the program's sounding voices so they can render
+// into that bus together. Listed says whether the program is among those
+// whose bus the process thread is running; a program is only idle, and
+// safe to delete, once it has been taken off.
+class RenderProgram {
+  private:
+    std::vector<VoiceBase*> voices;
+    std::vector<VoiceBase*> free_voices;
+    std::vector<VoiceBase*> sounding;
+    EffectBus effects;
+    bool listed;
+  public:
+    RenderProgram(const Patch&, int);
+    ~RenderProgram();
+    VoiceBase* acquire();
+    void release(VoiceBase*);
+    bool isIdle() const { return free_voices.size() == voices.size() && !listed; }
+    int getPolyphony() const { return voices.size(); }
+    EffectBus& getEffects() { return effects; }
+    void clearSounding() { sounding.clear(); }
+    void addSounding(VoiceBase* voice) { sounding.push_back(voice); }
+    const std::vector<VoiceBase*>& getSounding() const { return sounding; }
+    bool isListed() const { return listed; }
+    void setListed(bool value) { listed = value; }
+    void setSampleRate(int);
+    void setBufferSize(int);
+};
+
+#endif // JACK_MIDI_SYNTH_RENDER_PROGRAM_H
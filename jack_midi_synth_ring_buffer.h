@@ -0,0 +1,48 @@
+#ifndef JACK_MIDI_SYNTH_RING_BUFFER_H
+#define JACK_MIDI_SYNTH_RING_BUFFER_H
+
+#include <atomic>
+#include <vector>
+
+// Single-producer single-consumer queue. The storage is allocated once in
+// the constructor (rounded up to a power of two), after which push and pop
+// never block or allocate, so either end can be the real-time thread.
+template <class T>
+class RingBuffer {
+  private:
+    std::vector<T> items;
+    size_t mask;
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+  public:
+    RingBuffer(size_t capacity) : head(0), tail(0) {
+      size_t size = 1;
+      while (size < capacity) size <<= 1;
+      items.resize(size);
+      mask = size - 1;
+    }
+    size_t capacity() const { return items.size(); }
+    size_t size() const { return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire); }
+    bool push(const T& item) {
+      size_t write = tail.load(std::memory_order_relaxed);
+      if (write - head.load(std::memory_order_acquire) == items.size()) return false;
+      items[write & mask] = item;
+      tail.store(write + 1, std::memory_order_release);
+      return true;
+    }
+    // Empties the queue from either end. Only safe while the other end is
+    // known not to be using it.
+    void clear() {
+      head.store(0, std::memory_order_relaxed);
+      tail.store(0, std::memory_order_release);
+    }
+    bool pop(T& item) {
+      size_t read = head.load(std::memory_order_relaxed);
+      if (read == tail.load(std::memory_order_acquire)) return false;
+      item = items[read & mask];
+      head.store(read + 1, std::memory_order_release);
+      return true;
+    }
+};
+
+#endif // JACK_MIDI_SYNTH_RING_BUFFER_H
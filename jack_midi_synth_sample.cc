@@ -1,15 +1,30 @@
 #include <iostream>
+#include <algorithm>
+
+#include <sys/stat.h>
 
 #include "jack_midi_synth_sample.h"
 
-#include <sndfile.h>
 
-Sample::Sample(const char* filename, float init_pitch) : pitch(init_pitch) {
+// Frames read from the file at a time, before mixing down to mono.
+const int kReadFrames = 4096;
+
+
+Sample::Sample(const char* filename, const SampleCache* cache, float init_pitch) : cached{nullptr, 0, nullptr, 0, 0}, frames(nullptr), length(0), pitch(init_pitch), sample_rate(0), users(0) {
+  if (cache && cache->open(filename, cached)) {
+    frames = cached.frames;
+    length = cached.length;
+    sample_rate = cached.sample_rate;
+    return;
+  }
+  CacheHeader source;
+  bool described = cache && cache->describe(filename, source);
   SF_INFO sfinfo;
   SNDFILE *sound_file = sf_open(filename, SFM_READ, &sfinfo);
   if (int error=sf_error(sound_file)) {
-    std::cerr << sf_error_number(error) << std::endl;
+    std::cerr << filename << ": " << sf_error_number(error) << std::endl;
   } else {
+    sample_rate = sfinfo.samplerate;
     audio.resize(sfinfo.frames);
     int items = sfinfo.frames * sfinfo.channels;
     std::vector<float> all_channels(items);
@@ -19,13 +34,95 @@ Sample::Sample(const char* filename, float init_pitch) : pitch(init_pitch) {
         audio[i] += all_channels[i * sfinfo.channels + j] / sfinfo.channels;
       }
     }
+    sf_close(sound_file);
+    if (described) cache->store(filename, source, sample_rate, audio);
   }
+  frames = audio.data();
+  length = audio.size();
+}
+
+Sample::~Sample() {
+  SampleCache::close(cached);
 }
 
 float Sample::getAmplitude(int sample) {
-  if (audio.size()) {
-    sample %= audio.size();
-    return audio[sample];
+  if (length) {
+    sample %= length;
+    return frames[sample];
   }
   return 0;
 }
+
+time_t modificationTime(const char* filename) {
+  struct stat status;
+  if (stat(filename, &status)) return 0;
+  return status.st_mtime;
+}
+
+SampleSlot::SampleSlot(const char* init_filename) : filename(init_filename), current(nullptr), state(SLOT_QUEUED), modified(modificationTime(init_filename)) {}
+
+// Called on the process thread as a voice starts a note.
+Sample* SampleSlot::acquire() {
+  Sample* sample = current.load(std::memory_order_acquire);
+  if (sample) sample->addUser();
+  return sample;
+}
+
+// Makes sample the version new notes start on, returning the one it
+// replaces.
+Sample* SampleSlot::publish(Sample* sample) {
+  Sample* previous = current.exchange(sample, std::memory_order_acq_rel);
+  state.store(SLOT_READY, std::memory_order_release);
+  return previous;
+}
+
+// Whether the caller gets to decode the first version. Only one caller
+// ever does.
+bool SampleSlot::claim() {
+  int queued = SLOT_QUEUED;
+  return state.compare_exchange_strong(queued, SLOT_LOADING, std::memory_order_acq_rel);
+}
+
+// Whether the file has been modified since the last call, or since the
+// slot was made.
+bool SampleSlot::hasChanged() {
+  time_t time = modificationTime(filename.c_str());
+  if (time == modified) return false;
+  modified = time;
+  return true;
+}
+
+
+StreamedSample::StreamedSample(SNDFILE* init_file, const SF_INFO& sfinfo, long preload_frames, float init_pitch) : file(init_file), channels(sfinfo.channels), frames(sfinfo.frames), pitch(init_pitch), sample_rate(sfinfo.samplerate), preload(std::min(preload_frames, frames)), interleaved(kReadFrames * sfinfo.channels) {
+  read(0, preload.data(), preload.size());
+}
+
+StreamedSample::~StreamedSample() {
+  sf_close(file);
+}
+
+// Reads count frames from start on, mixed down to mono, going round to the
+// beginning again at the end of the file as Sample::getAmplitude does.
+void StreamedSample::read(long start, float* out, int count) {
+  start %= frames;
+  sf_seek(file, start, SEEK_SET);
+  while (count > 0) {
+    int wanted = std::min<long>(std::min(count, kReadFrames), frames - start);
+    int got = sf_readf_float(file, interleaved.data(), wanted);
+    if (got <= 0) {
+      std::fill(out, out + count, 0.0f);
+      return;
+    }
+    for (int i=0; i < got; ++i) {
+      out[i] = 0.0;
+      for (int j=0; j < channels; ++j) out[i] += interleaved[i * channels + j] / channels;
+    }
+    out += got;
+    count -= got;
+    start += got;
+    if (start == frames) {
+      start = 0;
+      sf_seek(file, 0, SEEK_SET);
+    }
+  }
+}
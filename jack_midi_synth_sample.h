@@ -1,15 +1,104 @@
 #ifndef JACK_MIDI_SYNTH_SAMPLE_H
 #define JACK_MIDI_SYNTH_SAMPLE_H
 
+#include <atomic>
+#include <ctime>
+#include <string>
 #include <vector>
 
+#include <sndfile.h>
+
+#include "jack_midi_synth_sample_cache.h"
+
+// The pitch a sample is taken to have been recorded at, in Hz, unless a
+// patch says otherwise.
+const float kDefaultSamplePitch = 261.2;
+
+// The file's modification time, or 0 if it can't be read.
+time_t modificationTime(const char*);
+
+// One decoded version of a sample file. Users counts the voices playing
+// it, so that a version replaced by a reload is only freed once they have
+// all moved on. Given a cache, the frames are mapped from it if it has a
+// current entry for the file, and stored in it once decoded otherwise.
 class Sample {
   private:
     std::vector<float> audio;
+    CachedSample cached;
+    const float* frames;
+    long length;
     float pitch;
+    int sample_rate;
+    std::atomic<int> users;
   public:
-    Sample(const char*, float=261.2);
+    Sample(const char*, const SampleCache* =nullptr, float=kDefaultSamplePitch);
+    Sample(const Sample&) = delete;
+    Sample& operator=(const Sample&) = delete;
+    ~Sample();
     float getAmplitude(int);
+    float getPitch() const { return pitch; }
+    int getSampleRate() const { return sample_rate; }
+    const float* getFrames() const { return frames; }
+    long getLength() const { return length; }
+    std::vector<float> copyFrames() const { return std::vector<float>(frames, frames + length); }
+    void addUser() { users.fetch_add(1, std::memory_order_relaxed); }
+    void release() { users.fetch_sub(1, std::memory_order_release); }
+    int getUsers() const { return users.load(std::memory_order_acquire); }
+};
+
+
+// Where the current version of one sample file is published. Versions are
+// decoded off the process thread by the SampleLoader and swapped in with
+// a single atomic store, and a voice takes the current one, counting
+// itself as a user, each time it starts a note. The slot is null until the
+// first version has been decoded, and the voice plays silence meanwhile.
+class SampleSlot {
+  public:
+    enum State {
+      SLOT_QUEUED = 0,
+      SLOT_LOADING,
+      SLOT_READY
+    };
+  private:
+    std::string filename;
+    std::atomic<Sample*> current;
+    std::atomic<int> state;
+    time_t modified;
+  public:
+    SampleSlot(const char*);
+    ~SampleSlot() { delete current.load(); }
+    const char* getFilename() const { return filename.c_str(); }
+    Sample* getCurrent() const { return current.load(std::memory_order_acquire); }
+    Sample* acquire();
+    Sample* publish(Sample*);
+    bool claim();
+    bool isReady() const { return state.load(std::memory_order_acquire) == SLOT_READY; }
+    bool hasChanged();
+};
+
+
+// A sample too long to keep in memory. Only the first stretch is decoded
+// up front; the rest stays in the file for the disk thread to read as
+// voices reach it, one SampleStream per voice. The file handle is shared
+// by every stream of the sample, so read is only called from the disk
+// thread.
+class StreamedSample {
+  private:
+    SNDFILE* file;
+    int channels;
+    long frames;
+    float pitch;
+    int sample_rate;
+    std::vector<float> preload;
+    std::vector<float> interleaved;
+  public:
+    StreamedSample(SNDFILE*, const SF_INFO&, long, float=kDefaultSamplePitch);
+    ~StreamedSample();
+    long getFrames() const { return frames; }
+    float getPitch() const { return pitch; }
+    int getSampleRate() const { return sample_rate; }
+    const std::vector<float>& getPreload() const { return preload; }
+    void read(long, float*, int);
 };
 
 #endif // JACK_MIDI_SYNTH_SAMPLE_H
@@ -0,0 +1,142 @@
+#include <iostream>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "jack_midi_synth_sample_cache.h"
+
+
+const char kCacheMagic[8] = {'J', 'M', 'S', 'C', 'A', 'C', 'H', 'E'};
+const uint32_t kCacheVersion = 1;
+// The frames start on a multiple of this, past the header and path.
+const long kCacheAlignment = 64;
+
+static_assert(sizeof(CacheHeader) == kCacheAlignment, "cache header should fill one alignment unit");
+
+// The source's absolute path, size and modification time in nanoseconds,
+// which together say whether an entry is still current. False if the
+// source can't be found.
+bool describeSource(const char* filename, std::string& path, CacheHeader& header) {
+  char* absolute = realpath(filename, NULL);
+  if (!absolute) return false;
+  path = absolute;
+  free(absolute);
+  struct stat status;
+  if (stat(path.c_str(), &status)) return false;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kCacheMagic, sizeof(header.magic));
+  header.version = kCacheVersion;
+  header.path_length = path.size();
+  header.source_size = status.st_size;
+  header.source_modified = static_cast<int64_t>(status.st_mtim.tv_sec) * 1000000000 + status.st_mtim.tv_nsec;
+  return true;
+}
+
+long getFramesOffset(const CacheHeader& header) {
+  long end = sizeof(CacheHeader) + header.path_length;
+  return (end + kCacheAlignment - 1) / kCacheAlignment * kCacheAlignment;
+}
+
+
+SampleCache::SampleCache(const char* init_directory) : directory(init_directory) {}
+
+// FNV-1a of the source's absolute path. The entry records the path as
+// well, so a collision only costs a decode.
+std::string SampleCache::getEntryPath(const std::string& source) const {
+  uint64_t hash = 14695981039346656037ULL;
+  for (unsigned char c: source) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.sample", static_cast<unsigned long long>(hash));
+  return directory + "/" + name;
+}
+
+// False if there is no current entry for the file. The pages are read in
+// while mapping, here on a loading thread, so that the process thread
+// doesn't fault them in from disk the first time a voice plays them.
+bool SampleCache::open(const char* filename, CachedSample& cached) const {
+  std::string source;
+  CacheHeader expected;
+  if (!describeSource(filename, source, expected)) return false;
+  int descriptor = ::open(getEntryPath(source).c_str(), O_RDONLY);
+  if (descriptor < 0) return false;
+  struct stat status;
+  if (fstat(descriptor, &status) || status.st_size < static_cast<off_t>(sizeof(CacheHeader))) {
+    ::close(descriptor);
+    return false;
+  }
+  int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+  flags |= MAP_POPULATE;
+#endif
+  void* mapping = mmap(NULL, status.st_size, PROT_READ, flags, descriptor, 0);
+  ::close(descriptor);
+  if (mapping == MAP_FAILED) return false;
+  const CacheHeader* header = static_cast<const CacheHeader*>(mapping);
+  const char* path = static_cast<const char*>(mapping) + sizeof(CacheHeader);
+  long frames_offset = getFramesOffset(*header);
+  bool current = memcmp(header->magic, expected.magic, sizeof(header->magic)) == 0 && header->version == expected.version && header->path_length == expected.path_length && header->source_size == expected.source_size && header->source_modified == expected.source_modified && header->frames >= 0 && frames_offset + header->frames * static_cast<long>(sizeof(float)) == status.st_size && memcmp(path, source.data(), source.size()) == 0;
+  if (!current) {
+    munmap(mapping, status.st_size);
+    return false;
+  }
+  cached.mapping = mapping;
+  cached.mapped_bytes = status.st_size;
+  cached.frames = reinterpret_cast<const float*>(static_cast<const char*>(mapping) + frames_offset);
+  cached.length = header->frames;
+  cached.sample_rate = header->sample_rate;
+  return true;
+}
+
+// The header for the source as it is now, to be taken before decoding it.
+// False if the source can't be found.
+bool SampleCache::describe(const char* filename, CacheHeader& header) const {
+  std::string source;
+  return describeSource(filename, source, header);
+}
+
+// Stores nothing if the source has changed since it was described, as when
+// it was still being saved, since the frames may not match it. Failing to
+// write an entry is reported but otherwise harmless; the file is just
+// decoded again next time.
+void SampleCache::store(const char* filename, const CacheHeader& decoded, int sample_rate, const std::vector<float>& frames) const {
+  std::string source;
+  CacheHeader header;
+  if (!describeSource(filename, source, header)) return;
+  if (header.path_length != decoded.path_length || header.source_size != decoded.source_size || header.source_modified != decoded.source_modified) return;
+  header.frames = frames.size();
+  header.sample_rate = sample_rate;
+  std::string entry = getEntryPath(source);
+  std::string temporary = entry + ".XXXXXX";
+  int descriptor = mkstemp(&temporary[0]);
+  if (descriptor < 0) {
+    std::cerr << "Unable to write sample cache entry in " << directory << ": " << strerror(errno) << std::endl;
+    return;
+  }
+  // Readable by every synth on the machine, not just this user's.
+  fchmod(descriptor, 0644);
+  std::vector<char> head(getFramesOffset(header), 0);
+  memcpy(head.data(), &header, sizeof(header));
+  memcpy(head.data() + sizeof(header), source.data(), source.size());
+  size_t frame_bytes = frames.size() * sizeof(float);
+  bool written = write(descriptor, head.data(), head.size()) == static_cast<ssize_t>(head.size()) && write(descriptor, frames.data(), frame_bytes) == static_cast<ssize_t>(frame_bytes);
+  ::close(descriptor);
+  if (!written || rename(temporary.c_str(), entry.c_str())) {
+    std::cerr << "Unable to write sample cache entry " << entry << std::endl;
+    unlink(temporary.c_str());
+  }
+}
+
+void SampleCache::close(CachedSample& cached) {
+  if (cached.mapping) munmap(cached.mapping, cached.mapped_bytes);
+  cached.mapping = nullptr;
+}
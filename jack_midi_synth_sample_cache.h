@@ -0,0 +1,58 @@
+#ifndef JACK_MIDI_SYNTH_SAMPLE_CACHE_H
+#define JACK_MIDI_SYNTH_SAMPLE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A decoded sample mapped from the cache. Mapping is null if nothing is
+// mapped.
+struct CachedSample {
+  void* mapping;
+  size_t mapped_bytes;
+  const float* frames;
+  long length;
+  int sample_rate;
+};
+
+// The header at the start of an entry. Taken before a source is decoded,
+// it also records which state of the source the frames come from.
+struct CacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t path_length;
+  int64_t source_size;
+  int64_t source_modified;
+  int64_t frames;
+  int32_t sample_rate;
+  char unused[20];
+};
+
+
+// Samples already decoded and mixed down to mono, kept in a directory so
+// that later starts map them instead of decoding them again. Each source
+// file has an entry of its own, named for a hash of its absolute path,
+// holding a header that records the path, size and modification time the
+// frames were decoded from, followed by the frames themselves. An entry
+// whose header no longer matches its source is ignored and replaced the
+// next time the source is decoded. Entries are mapped read-only and
+// shared, so synths on the same machine playing the same samples share
+// their pages too, and are written under a temporary name and renamed
+// into place, so a reader only ever sees a whole entry. The source is
+// described before it is decoded, and an entry is only stored if the
+// source still matches that description afterwards, so a file saved
+// during the decode is never paired with frames from before it.
+class SampleCache {
+  private:
+    std::string directory;
+    std::string getEntryPath(const std::string&) const;
+  public:
+    SampleCache(const char*);
+    bool open(const char*, CachedSample&) const;
+    bool describe(const char*, CacheHeader&) const;
+    void store(const char*, const CacheHeader&, int, const std::vector<float>&) const;
+    static void close(CachedSample&);
+};
+
+#endif // JACK_MIDI_SYNTH_SAMPLE_CACHE_H
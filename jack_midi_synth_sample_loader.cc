@@ -0,0 +1,128 @@
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+
+#include <unistd.h>
+
+#include "jack_midi_synth_sample_loader.h"
+
+
+const int kPollMicroseconds = 10000;
+const int kPollsPerReport = 100;
+
+
+SampleLoader::SampleLoader() : running(true), queued(0), finished(0), cycles(0), cache(nullptr) {
+  pthread_mutex_init(&lock, NULL);
+  sem_init(&wake, 0, 0);
+}
+
+SampleLoader::~SampleLoader() {
+  stop();
+  for (auto& version: retired) delete version.sample;
+  sem_destroy(&wake);
+  pthread_mutex_destroy(&lock);
+}
+
+// Jobs still queued are dropped, and the threads finish the decode they
+// are in before returning.
+void SampleLoader::stop() {
+  running = false;
+  for (int i=0; i < threads.size(); ++i) sem_post(&wake);
+  for (auto thread: threads) pthread_join(thread, NULL);
+  threads.clear();
+}
+
+void SampleLoader::start() {
+  long cores = std::max(sysconf(_SC_NPROCESSORS_ONLN), 1L);
+  threads.resize(cores);
+  for (auto& thread: threads) {
+    if (pthread_create(&thread, NULL, SampleLoader::static_work, this)) {
+      std::cerr << "Unable to start sample loading thread" << std::endl;
+      exit(1);
+    }
+  }
+}
+
+// Queues a decode of the slot's file. The first request for a slot is
+// skipped if wait has already decoded it, while a reload always decodes a
+// new version.
+void SampleLoader::request(SampleSlot* slot, bool reload) {
+  if (!running) return;
+  if (threads.empty()) start();
+  queued.fetch_add(1, std::memory_order_relaxed);
+  pthread_mutex_lock(&lock);
+  jobs.push_back({slot, reload});
+  pthread_mutex_unlock(&lock);
+  sem_post(&wake);
+}
+
+// The slot's first version, decoding it on the calling thread if no
+// loading thread has started on it yet.
+Sample* SampleLoader::wait(SampleSlot* slot) {
+  if (slot->claim()) decode(slot);
+  while (!slot->isReady()) usleep(kPollMicroseconds / 10);
+  return slot->getCurrent();
+}
+
+// Reports progress about once a second, and only if loading takes that
+// long.
+void SampleLoader::waitForAll(std::ostream& out) {
+  bool reported = false;
+  for (int polls=1; finished.load(std::memory_order_acquire) < queued.load(std::memory_order_relaxed); ++polls) {
+    usleep(kPollMicroseconds);
+    if (polls % kPollsPerReport == 0) {
+      out << "Loading samples: " << finished.load(std::memory_order_relaxed) << "/" << queued.load(std::memory_order_relaxed) << std::endl;
+      reported = true;
+    }
+  }
+  if (reported) out << "Loaded " << queued.load(std::memory_order_relaxed) << " samples" << std::endl;
+}
+
+void SampleLoader::collect() {
+  unsigned long now = cycles.load(std::memory_order_acquire);
+  pthread_mutex_lock(&lock);
+  auto kept = std::remove_if(retired.begin(), retired.end(), [now](const Retired& version) {
+    if (now < version.cycle + 2 || version.sample->getUsers() > 0) return false;
+    delete version.sample;
+    return true;
+  });
+  retired.erase(kept, retired.end());
+  pthread_mutex_unlock(&lock);
+}
+
+// A reload that fails to decode, as when the file is caught half
+// written, keeps the version already playing; the first version is
+// published either way, so that waiting for it finishes. The cycle is
+// read after publishing, so any voice that took the old version did so in
+// that cycle or before.
+void SampleLoader::decode(SampleSlot* slot) {
+  Sample* sample = new Sample(slot->getFilename(), cache);
+  if (sample->getLength() == 0 && slot->getCurrent()) {
+    std::cerr << "Unable to reload " << slot->getFilename() << ", keeping the previous version" << std::endl;
+    delete sample;
+    return;
+  }
+  Sample* previous = slot->publish(sample);
+  if (!previous) return;
+  pthread_mutex_lock(&lock);
+  retired.push_back({previous, cycles.load(std::memory_order_acquire)});
+  pthread_mutex_unlock(&lock);
+}
+
+void* SampleLoader::static_work(void* arg) {
+  reinterpret_cast<SampleLoader*>(arg)->work();
+  return NULL;
+}
+
+void SampleLoader::work() {
+  for (;;) {
+    sem_wait(&wake);
+    if (!running) return;
+    pthread_mutex_lock(&lock);
+    Job job = jobs.front();
+    jobs.pop_front();
+    pthread_mutex_unlock(&lock);
+    if (job.reload || job.slot->claim()) decode(job.slot);
+    finished.fetch_add(1, std::memory_order_release);
+  }
+}
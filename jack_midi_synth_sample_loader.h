@@ -0,0 +1,59 @@
+#ifndef JACK_MIDI_SYNTH_SAMPLE_LOADER_H
+#define JACK_MIDI_SYNTH_SAMPLE_LOADER_H
+
+#include <atomic>
+#include <deque>
+#include <ostream>
+#include <vector>
+
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "jack_midi_synth_sample.h"
+
+// Decodes samples on a pool of background threads, one per core, started
+// the first time a sample is requested. Each decoded version is published
+// to its SampleSlot, and the version it replaces is retired: it is only
+// freed by collect once no voice is playing it and the process thread has
+// passed two cycles since, so no voice can still be about to take it. A
+// voice stops playing a version once its note has ended and it has gone
+// back to its program's free list, whether or not it plays again.
+// Loads are counted so that startup can report its progress and wait for
+// them all. With a cache, samples are mapped from it where they can be.
+class SampleLoader {
+  private:
+    struct Job {
+      SampleSlot* slot;
+      bool reload;
+    };
+    struct Retired {
+      Sample* sample;
+      unsigned long cycle;
+    };
+    std::vector<pthread_t> threads;
+    std::deque<Job> jobs;
+    std::vector<Retired> retired;
+    pthread_mutex_t lock;
+    sem_t wake;
+    std::atomic<bool> running;
+    std::atomic<int> queued;
+    std::atomic<int> finished;
+    std::atomic<unsigned long> cycles;
+    const SampleCache* cache;
+    static void* static_work(void*);
+    void work();
+    void start();
+    void decode(SampleSlot*);
+  public:
+    SampleLoader();
+    ~SampleLoader();
+    void setCache(const SampleCache* new_cache) { cache = new_cache; }
+    void request(SampleSlot*, bool=false);
+    Sample* wait(SampleSlot*);
+    void waitForAll(std::ostream&);
+    void passCycle() { cycles.fetch_add(1, std::memory_order_release); }
+    void collect();
+    void stop();
+};
+
+#endif // JACK_MIDI_SYNTH_SAMPLE_LOADER_H
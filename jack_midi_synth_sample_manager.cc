@@ -1,10 +1,30 @@
+#include <iostream>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+
+#include <sys/stat.h>
+
 #include "jack_midi_synth_sample_manager.h"
 
 
+// The loading threads are stopped first, as they may be decoding into the
+// slots.
 SampleManager::~SampleManager() {
+  loader.stop();
   for (auto& sample: samples) {
     delete sample.second;
   }
+  for (auto& sample: streamed_samples) {
+    delete sample.second;
+  }
+  for (auto& wavetable: wavetables) {
+    delete wavetable.second;
+  }
+  for (auto& keymap: keymaps) {
+    delete keymap.second;
+  }
+  delete cache;
 }
 
 SampleManager& SampleManager::get() {
@@ -12,10 +32,98 @@ SampleManager& SampleManager::get() {
   return instance;
 }
 
-Sample* SampleManager::getSample(const char* filename) {
+// Makes the directory if need be. Must be set before any sample is asked
+// for, as the loading threads read it without locking.
+bool SampleManager::setCacheDirectory(const char* directory) {
+  struct stat status;
+  if (mkdir(directory, 0755) && errno != EEXIST) {
+    std::cerr << "Unable to make sample cache directory " << directory << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+  if (stat(directory, &status) || !S_ISDIR(status.st_mode)) {
+    std::cerr << directory << " is not a directory" << std::endl;
+    return false;
+  }
+  delete cache;
+  cache = new SampleCache(directory);
+  loader.setCache(cache);
+  return true;
+}
+
+// Queues the file to be decoded in the background the first time it is
+// asked for.
+SampleSlot* SampleManager::getSampleSlot(const char* filename) {
   auto this_sample = samples.find(filename);
-  if (this_sample == samples.end()) {
-    samples[filename] = new Sample(filename);
-    return samples[filename];
-  } else return this_sample->second;
+  if (this_sample != samples.end()) return this_sample->second;
+  SampleSlot* slot = new SampleSlot(filename);
+  samples[filename] = slot;
+  loader.request(slot);
+  return slot;
+}
+
+// Waits for the file's first version and keeps it: whoever asks for a
+// Sample directly holds on to it rather than going through the slot, so
+// the file is left out of reloading.
+Sample* SampleManager::getSample(const char* filename) {
+  pinned.insert(filename);
+  return loader.wait(getSampleSlot(filename));
+}
+
+// Queues a new version of each in-memory sample whose file has changed
+// since it was last loaded. Streamed samples keep reading the file they
+// opened.
+void SampleManager::reloadChanged() {
+  for (auto& sample: samples) {
+    if (pinned.count(sample.first) || !sample.second->hasChanged()) continue;
+    std::cerr << "Reloading " << sample.first << std::endl;
+    loader.request(sample.second, true);
+  }
+}
+
+// Null unless streaming is on (a preload has been set) and the file runs
+// past the preload, in which case Audio should stream it rather than use
+// getSample. Files that fit in the preload are left whole in memory.
+StreamedSample* SampleManager::getStreamedSample(const char* filename) {
+  if (preload_milliseconds <= 0.0) return nullptr;
+  auto this_sample = streamed_samples.find(filename);
+  if (this_sample != streamed_samples.end()) return this_sample->second;
+  StreamedSample* sample = nullptr;
+  SF_INFO sfinfo;
+  SNDFILE *sound_file = sf_open(filename, SFM_READ, &sfinfo);
+  if (sound_file && !sf_error(sound_file)) {
+    long preload_frames = std::ceil(preload_milliseconds * sfinfo.samplerate / 1000.0);
+    if (sfinfo.frames > preload_frames) {
+      sample = new StreamedSample(sound_file, sfinfo, preload_frames);
+    } else {
+      sf_close(sound_file);
+    }
+  }
+  streamed_samples[filename] = sample;
+  return sample;
+}
+
+// A single-cycle WAV imported as a wavetable, the whole file being one
+// period. Null if the file would not load, which is remembered rather
+// than reported again.
+const Wavetable* SampleManager::getWavetable(const char* filename) {
+  auto this_wavetable = wavetables.find(filename);
+  if (this_wavetable != wavetables.end()) return this_wavetable->second;
+  Sample* sample = getSample(filename);
+  Wavetable* wavetable = sample->getLength() > 0 ? new Wavetable(sample->copyFrames()) : nullptr;
+  wavetables[filename] = wavetable;
+  return wavetable;
+}
+
+// Null if the keymap would not load, which is remembered rather than
+// reported again.
+Keymap* SampleManager::getKeymap(const char* filename) {
+  auto this_keymap = keymaps.find(filename);
+  if (this_keymap != keymaps.end()) return this_keymap->second;
+  Keymap* keymap = new Keymap;
+  if (!keymap->load(filename)) {
+    delete keymap;
+    keymap = nullptr;
+  }
+  keymaps[filename] = keymap;
+  return keymap;
 }
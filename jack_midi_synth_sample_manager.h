@@ -1,19 +1,42 @@
 #ifndef JACK_MIDI_SYNTH_SAMPLE_MANAGER_H
 #define JACK_MIDI_SYNTH_SAMPLE_MANAGER_H
 
+#include <ostream>
 #include <string>
 #include <map>
+#include <set>
 
+#include "jack_midi_synth_keymap.h"
 #include "jack_midi_synth_sample.h"
+#include "jack_midi_synth_sample_cache.h"
+#include "jack_midi_synth_sample_loader.h"
+#include "jack_midi_synth_wavetable.h"
 
 class SampleManager {
   private:
-    SampleManager() {};
+    SampleManager() : preload_milliseconds(0.0), cache(nullptr) {};
     ~SampleManager();
-    std::map<std::string, Sample*> samples;
+    std::map<std::string, SampleSlot*> samples;
+    std::set<std::string> pinned;
+    std::map<std::string, StreamedSample*> streamed_samples;
+    std::map<std::string, Wavetable*> wavetables;
+    std::map<std::string, Keymap*> keymaps;
+    float preload_milliseconds;
+    SampleCache* cache;
+    SampleLoader loader;
   public:
     static SampleManager& get();
+    void setPreload(float milliseconds) { preload_milliseconds = milliseconds; }
+    bool setCacheDirectory(const char*);
+    SampleSlot* getSampleSlot(const char*);
     Sample* getSample(const char*);
+    StreamedSample* getStreamedSample(const char*);
+    const Wavetable* getWavetable(const char*);
+    Keymap* getKeymap(const char*);
+    void waitForLoads(std::ostream& out) { loader.waitForAll(out); }
+    void reloadChanged();
+    void collect() { loader.collect(); }
+    void passCycle() { loader.passCycle(); }
 };
 
 #endif // JACK_MIDI_SYNTH_SAMPLE_MANAGER_H
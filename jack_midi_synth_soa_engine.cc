@@ -0,0 +1,396 @@
+#include "jack_midi_synth_soa_engine.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "jack_midi_synth_events.h"
+#include "jack_midi_synth_fast_math.h"
+#include "jack_midi_synth_kernels.h"
+#include "jack_midi_synth_profiler.h"
+#include "jack_midi_synth_sample.h"
+#include "jack_midi_synth_sample_manager.h"
+
+
+// Stands in for the remaining frames of a stage that never ends by itself.
+const int kForever = 1 << 30;
+
+
+// Phase step per frame of a note, rounded the same way as Voice::render.
+inline float noteStep(int note, int rate) {
+  float pitch = fastExp2((note - 69.0f) / 12.0f) * 440.0f;
+  return pitch / rate;
+}
+
+
+// The same patch as Voice::Voice.
+SoaEngine::SoaEngine(int init_polyphony, VoicePool::StealPolicy init_policy) : polyphony(std::max(init_polyphony, 1)), active(0), policy(init_policy), sample_rate(48000), buffer_size(0), pedal(false), order_counter(0) {
+  capacity = (polyphony + kSoaLanes - 1) / kSoaLanes * kSoaLanes;
+  note.resize(capacity);
+  velocity.resize(capacity);
+  base_step.resize(capacity);
+  released.resize(capacity);
+  trigger_frame.resize(capacity);
+  order.resize(capacity);
+  pass_low.resize(capacity);
+  pass_high.resize(capacity);
+  envelopes.reserve(8);
+  slots.reserve(7);
+  addEnvelope(new LADSR(0.06, 0.25, 0.9, 1.5, 0.01));
+  addSample("test.wav",            new LADSR(0.1, 0.5, 0.9, 3.0), 0.8);            // Sample
+  addOscillator("Sine", kernelSine, 2.0,          new LADSR(0.06, 0.15, 0.8,  1.0, 0.015), 0.2); // Sub
+  addOscillator("Triangle", kernelTriangle, -1.0, new LADSR(0.06, 0.2,  0.65, 0.9, 0.015), 0.1); // Sub fifth
+  addOscillator("Triangle", kernelTriangle, 0.0,  new LADSR(0.05, 0.25, 0.5,  0.8, 0.02), 0.7);  // Main
+  addOscillator("Sine", kernelSine, 7.0/12.0,     new LADSR(0.04, 0.2,  0.7,  0.7, 0.02), 0.3);  // Fifth
+  addOscillator("Sine", kernelSine, 1.0,          new LADSR(0.03, 0.15, 0.4,  0.6, 0.02), 0.4);  // Octave
+  addOscillator("Pulse", kernelPulse, 2.0,        new LADSR(0.02, 0.1,  0.3,  0.5, 0.02), 0.05); // Octave 2
+  // The built-in patch has one filter, a Pass run across all the lanes.
+  PROFILE_NAME(PROFILE_FILTER, "filter", "Pass");
+  for (int lane=0; lane < capacity; ++lane) clearLane(lane);
+  setSampleRate(sample_rate);
+}
+
+SoaEngine::~SoaEngine() {
+  for (auto& bank: envelopes) delete bank.prototype;
+}
+
+int SoaEngine::addEnvelope(SegmentEnvelope* prototype) {
+  envelopes.push_back(EnvelopeLanes(prototype));
+  EnvelopeLanes& bank = envelopes.back();
+  bank.level.resize(capacity);
+  bank.multiplier.resize(capacity);
+  bank.increment.resize(capacity);
+  bank.remaining.resize(capacity);
+  bank.stage.resize(capacity);
+  bank.segment.resize(capacity);
+  bank.sounding.resize(capacity);
+  return envelopes.size() - 1;
+}
+
+void SoaEngine::addOscillator(const char* type, void (*kernel)(const float*, float*, int), float tune, SegmentEnvelope* envelope, float mix) {
+  int index = slots.size();
+  if (index < kMaxProfiledOscillators) PROFILE_NAME(PROFILE_OSCILLATOR + index, "oscillator", type);
+  slots.push_back(OscillatorSlot());
+  OscillatorSlot& slot = slots.back();
+  slot.kernel = kernel;
+  slot.tuning = pow(2.0, tune);
+  slot.sample = nullptr;
+  slot.mix = mix;
+  slot.envelope = addEnvelope(envelope);
+  slot.phase.resize(capacity);
+  slot.position.resize(capacity);
+}
+
+void SoaEngine::addSample(const char* filename, SegmentEnvelope* envelope, float mix) {
+  addOscillator("Audio", nullptr, 0.0, envelope, mix);
+  slots.back().sample = SampleManager::get().getSample(filename);
+}
+
+int SoaEngine::findLane(int this_note) const {
+  for (int lane=0; lane < active; ++lane) {
+    if (note[lane] == this_note && !released[lane]) return lane;
+  }
+  return -1;
+}
+
+// Lanes are not kept in trigger order, so ties go to the oldest voice as
+// they do in VoicePool.
+int SoaEngine::stealLane() const {
+  int victim = 0;
+  for (int lane=1; lane < active; ++lane) {
+    if (policy == VoicePool::STEAL_QUIETEST) {
+      float level = velocity[lane] * envelopes[0].level[lane];
+      float quietest = velocity[victim] * envelopes[0].level[victim];
+      if (level < quietest || (level == quietest && order[lane] < order[victim])) victim = lane;
+    } else if (order[lane] < order[victim]) {
+      victim = lane;
+    }
+  }
+  return victim;
+}
+
+void SoaEngine::noteOn(int this_note, float this_velocity, int frame) {
+  int lane = findLane(this_note);
+  if (lane < 0 || policy != VoicePool::STEAL_SAME_NOTE) {
+    if (lane >= 0) released[lane] = true;
+    lane = active < polyphony ? active++ : stealLane();
+  }
+  triggerLane(lane, this_note, this_velocity, frame);
+}
+
+void SoaEngine::noteOff(int this_note) {
+  for (int lane=0; lane < active; ++lane) {
+    if (note[lane] == this_note) released[lane] = true;
+  }
+}
+
+// Envelopes wait in LANE_PENDING until the trigger frame comes round in
+// render, which stands in for Voice zero-filling the frames before it.
+void SoaEngine::triggerLane(int lane, int this_note, float this_velocity, int frame) {
+  note[lane] = this_note;
+  velocity[lane] = this_velocity;
+  base_step[lane] = noteStep(this_note, sample_rate);
+  released[lane] = false;
+  trigger_frame[lane] = frame;
+  order[lane] = order_counter++;
+  for (auto& bank: envelopes) {
+    bank.level[lane] = 0.0;
+    bank.multiplier[lane] = 1.0;
+    bank.increment[lane] = 0.0;
+    bank.remaining[lane] = kForever;
+    bank.stage[lane] = LANE_PENDING;
+    bank.sounding[lane] = true;
+  }
+  for (auto& slot: slots) {
+    slot.phase[lane] = 0.0;
+    slot.position[lane] = 0;
+  }
+}
+
+void SoaEngine::moveLane(int from, int to) {
+  note[to] = note[from];
+  velocity[to] = velocity[from];
+  base_step[to] = base_step[from];
+  released[to] = released[from];
+  trigger_frame[to] = trigger_frame[from];
+  order[to] = order[from];
+  for (auto& bank: envelopes) {
+    bank.level[to] = bank.level[from];
+    bank.multiplier[to] = bank.multiplier[from];
+    bank.increment[to] = bank.increment[from];
+    bank.remaining[to] = bank.remaining[from];
+    bank.stage[to] = bank.stage[from];
+    bank.segment[to] = bank.segment[from];
+    bank.sounding[to] = bank.sounding[from];
+  }
+  for (auto& slot: slots) {
+    slot.phase[to] = slot.phase[from];
+    slot.position[to] = slot.position[from];
+  }
+  pass_low[to] = pass_low[from];
+  pass_high[to] = pass_high[from];
+}
+
+// Cleared lanes beyond the active ones are still run through the kernels
+// when the active count is not a multiple of kSoaLanes, so everything that
+// feeds the output has to stay at zero.
+void SoaEngine::clearLane(int lane) {
+  note[lane] = -1;
+  velocity[lane] = 0.0;
+  base_step[lane] = 0.0;
+  released[lane] = true;
+  trigger_frame[lane] = 0;
+  order[lane] = 0;
+  for (auto& bank: envelopes) {
+    bank.level[lane] = 0.0;
+    bank.multiplier[lane] = 1.0;
+    bank.increment[lane] = 0.0;
+    bank.remaining[lane] = kForever;
+    bank.stage[lane] = LANE_IDLE;
+    bank.segment[lane] = 0;
+    bank.sounding[lane] = false;
+  }
+  for (auto& slot: slots) {
+    slot.phase[lane] = 0.0;
+    slot.position[lane] = 0;
+  }
+  pass_low[lane] = 0.0;
+  pass_high[lane] = 0.0;
+}
+
+// These mirror SegmentEnvelope::enterChain, enterRelease and the end of a
+// segment in SegmentEnvelope::render, for a single lane.
+void SoaEngine::enterChain(EnvelopeLanes& bank, int lane, int index) {
+  const auto& chain = bank.prototype->chain;
+  while (index < chain.size() && chain[index].frames == 0) bank.level[lane] = chain[index++].level;
+  if (index < chain.size()) {
+    bank.stage[lane] = LANE_CHAIN;
+    bank.segment[lane] = index;
+    bank.remaining[lane] = chain[index].frames;
+    bank.multiplier[lane] = chain[index].multiplier;
+    bank.increment[lane] = chain[index].increment;
+  } else if (bank.prototype->sustains) {
+    bank.stage[lane] = LANE_SUSTAIN;
+    bank.remaining[lane] = kForever;
+    bank.multiplier[lane] = 1.0;
+    bank.increment[lane] = 0.0;
+  } else {
+    enterRelease(bank, lane);
+  }
+}
+
+void SoaEngine::enterRelease(EnvelopeLanes& bank, int lane) {
+  SegmentEnvelope::Segment release = bank.prototype->release;
+  bank.prototype->prepare(release, bank.level[lane]);
+  bank.stage[lane] = LANE_RELEASE;
+  bank.remaining[lane] = release.frames;
+  bank.multiplier[lane] = release.multiplier;
+  bank.increment[lane] = release.increment;
+  if (release.frames == 0) advanceEnvelope(bank, lane);
+}
+
+void SoaEngine::advanceEnvelope(EnvelopeLanes& bank, int lane) {
+  switch (bank.stage[lane]) {
+    case LANE_PENDING:
+      bank.level[lane] = bank.prototype->start_level;
+      enterChain(bank, lane, 0);
+      break;
+    case LANE_CHAIN:
+      bank.level[lane] = bank.prototype->chain[bank.segment[lane]].level;
+      enterChain(bank, lane, bank.segment[lane] + 1);
+      break;
+    case LANE_RELEASE:
+      bank.level[lane] = bank.prototype->release.level;
+      bank.stage[lane] = LANE_IDLE;
+      bank.remaining[lane] = kForever;
+      bank.multiplier[lane] = 1.0;
+      bank.increment[lane] = 0.0;
+      if (bank.level[lane] <= 0.0) bank.sounding[lane] = false;
+      return;
+    default:
+      bank.remaining[lane] = kForever;
+      return;
+  }
+  if ((bank.stage[lane] == LANE_CHAIN || bank.stage[lane] == LANE_SUSTAIN) && released[lane] && !pedal) enterRelease(bank, lane);
+}
+
+// Runs every lane up to the next frame at which any active lane changes
+// segment, so the inner loop is the same multiply-add across all lanes and
+// only the lanes that hit the end of a segment drop to scalar code.
+void SoaEngine::renderEnvelope(EnvelopeLanes& bank, float* out, int width, int length) {
+  float* level = bank.level.data();
+  const float* multiplier = bank.multiplier.data();
+  const float* increment = bank.increment.data();
+  int frame = 0;
+  while (frame < length) {
+    int run = length - frame;
+    for (int lane=0; lane < active; ++lane) run = std::min(run, bank.remaining[lane]);
+    for (int end=frame + run; frame < end; ++frame) {
+      float* row = out + frame * width;
+      for (int lane=0; lane < width; ++lane) {
+        level[lane] = level[lane] * multiplier[lane] + increment[lane];
+        row[lane] = level[lane];
+      }
+    }
+    for (int lane=0; lane < active; ++lane) {
+      bank.remaining[lane] -= run;
+      if (bank.remaining[lane] == 0) advanceEnvelope(bank, lane);
+    }
+  }
+}
+
+bool SoaEngine::isSounding(int lane) const {
+  for (const auto& bank: envelopes) {
+    if (bank.sounding[lane]) return true;
+  }
+  return false;
+}
+
+void SoaEngine::render(const ControllerLane& bend_freq, const ControllerLane& mod_wheel, const ControllerLane& expression, const ControllerLane& aftertouch, const ControllerLane& sustain, float* out, int global_frame, int length) {
+  if (active == 0) return;
+  int width = std::min((active + kSoaLanes - 1) / kSoaLanes * kSoaLanes, capacity);
+  int samples = width * length;
+  pedal = sustain[sustain.size()/2];
+  float pulse_centre = std::min(std::max(0.5f + mod_wheel[mod_wheel.size()/2] * 0.5f, 0.01f), 0.99f);
+  float cutoff = std::min(std::max(1.0f - aftertouch[aftertouch.size()/2], 0.01f), 0.99f);
+  float resonance = std::min(std::max(aftertouch[aftertouch.size()/2], 0.01f), 0.99f);
+  float feedback = resonance + resonance / (1.0 - cutoff);
+
+  for (auto& bank: envelopes) {
+    for (int lane=0; lane < active; ++lane) {
+      if (bank.stage[lane] == LANE_PENDING) {
+        bank.remaining[lane] = std::max(trigger_frame[lane] - global_frame, 0);
+        if (bank.remaining[lane] == 0) advanceEnvelope(bank, lane);
+      } else if ((bank.stage[lane] == LANE_CHAIN || bank.stage[lane] == LANE_SUSTAIN) && released[lane] && !pedal) {
+        enterRelease(bank, lane);
+      }
+    }
+  }
+
+  {
+    PROFILE_SCOPE(PROFILE_ENVELOPES);
+    renderEnvelope(envelopes[0], amp.data(), width, length);
+  }
+  for (int frame=0; frame < length; ++frame) {
+    float* row = amp.data() + frame * width;
+    double scale = expression[frame] * (1.0 + aftertouch[frame]);
+    for (int lane=0; lane < width; ++lane) row[lane] *= velocity[lane] * scale;
+  }
+  memset(channel.data(), 0, samples * sizeof(float));
+
+  for (int s=0; s < slots.size(); ++s) {
+    OscillatorSlot& slot = slots[s];
+    {
+      PROFILE_SCOPE(PROFILE_OSCILLATOR + std::min(s, kMaxProfiledOscillators - 1));
+      if (slot.sample) {
+        memset(oscillator.data(), 0, samples * sizeof(float));
+        for (int lane=0; lane < active; ++lane) {
+          for (int frame=0; frame < length; ++frame) oscillator[frame * width + lane] = slot.sample->getAmplitude(slot.position[lane]++);
+        }
+      } else {
+        float* phase = slot.phase.data();
+        const float* step = base_step.data();
+        for (int frame=0; frame < length; ++frame) {
+          float* row = oscillator.data() + frame * width;
+          float bend = bend_freq[frame];
+          for (int lane=0; lane < width; ++lane) {
+            float offset = phase[lane] + bend * step[lane] * slot.tuning;
+            offset -= static_cast<int>(offset);
+            phase[lane] = offset;
+            row[lane] = offset;
+          }
+        }
+        kernelPulseWidthModulate(oscillator.data(), pulse_centre, samples);
+        slot.kernel(oscillator.data(), oscillator.data(), samples);
+      }
+    }
+    {
+      PROFILE_SCOPE(PROFILE_ENVELOPES);
+      renderEnvelope(envelopes[slot.envelope], weights.data(), width, length);
+    }
+    for (int i=0; i < samples; ++i) channel[i] += amp[i] * slot.mix * weights[i] * oscillator[i];
+  }
+
+  {
+    PROFILE_SCOPE(PROFILE_FILTER);
+    float* low = pass_low.data();
+    float* high = pass_high.data();
+    for (int frame=0; frame < length; ++frame) {
+      float* row = channel.data() + frame * width;
+      for (int lane=0; lane < width; ++lane) {
+        low[lane] += cutoff * (row[lane] - low[lane] + feedback * (low[lane] - high[lane]));
+        high[lane] += cutoff * (low[lane] - high[lane]);
+        row[lane] = high[lane];
+      }
+    }
+  }
+
+  PROFILE_SCOPE(PROFILE_VOICE_TANH);
+  for (int frame=0; frame < length; ++frame) {
+    const float* row = channel.data() + frame * width;
+    for (int lane=0; lane < active; ++lane) out[frame] += fastTanh(row[lane]);
+  }
+}
+
+void SoaEngine::retireSilent() {
+  for (int lane=active - 1; lane >= 0; --lane) {
+    if (isSounding(lane)) continue;
+    --active;
+    if (lane != active) moveLane(active, lane);
+    clearLane(active);
+  }
+}
+
+void SoaEngine::setSampleRate(int rate) {
+  sample_rate = rate;
+  for (auto& bank: envelopes) bank.prototype->setSampleRate(rate);
+  for (int lane=0; lane < active; ++lane) base_step[lane] = noteStep(note[lane], sample_rate);
+}
+
+void SoaEngine::setBufferSize(int size) {
+  buffer_size = size;
+  amp.resize(size * capacity);
+  channel.resize(size * capacity);
+  oscillator.resize(size * capacity);
+  weights.resize(size * capacity);
+}
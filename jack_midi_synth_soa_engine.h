@@ -0,0 +1,99 @@
+#ifndef JACK_MIDI_SYNTH_SOA_ENGINE_H
+#define JACK_MIDI_SYNTH_SOA_ENGINE_H
+
+#include <vector>
+
+#include "jack_midi_synth_envelopes.h"
+#include "jack_midi_synth_voice_pool.h"
+
+class ControllerLane;
+class Sample;
+
+const int kSoaLanes = 8;
+
+// A data-oriented alternative to VoicePool + Voice for the default patch.
+// Every piece of per-voice state (phases, envelope stages and levels,
+// filter state) lives in one array per slot indexed by lane, and
+// the active voices are kept packed at the front. Each oscillator slot is
+// then rendered for all voices at once into frame-major buffers, so the
+// inner loops run across voices with no virtual calls or pointer chasing.
+class SoaEngine {
+  private:
+    enum LaneStage {
+      LANE_IDLE = 0,
+      LANE_PENDING,
+      LANE_CHAIN,
+      LANE_SUSTAIN,
+      LANE_RELEASE
+    };
+    // The prototype envelope holds the segment coefficients shared by all
+    // lanes; the lanes only hold where each voice has got to.
+    struct EnvelopeLanes {
+      EnvelopeLanes(SegmentEnvelope* init_prototype) : prototype(init_prototype) {}
+      SegmentEnvelope* prototype;
+      std::vector<float> level;
+      std::vector<float> multiplier;
+      std::vector<float> increment;
+      std::vector<int> remaining;
+      std::vector<int> stage;
+      std::vector<int> segment;
+      std::vector<char> sounding;
+    };
+    struct OscillatorSlot {
+      void (*kernel)(const float*, float*, int);
+      float tuning;
+      Sample* sample;
+      float mix;
+      int envelope;
+      std::vector<float> phase;
+      std::vector<int> position;
+    };
+    int polyphony;
+    int capacity;
+    int active;
+    VoicePool::StealPolicy policy;
+    int sample_rate;
+    int buffer_size;
+    bool pedal;
+    long order_counter;
+    std::vector<int> note;
+    std::vector<float> velocity;
+    std::vector<float> base_step;
+    std::vector<char> released;
+    std::vector<int> trigger_frame;
+    std::vector<long> order;
+    std::vector<EnvelopeLanes> envelopes;
+    std::vector<OscillatorSlot> slots;
+    std::vector<float> pass_low;
+    std::vector<float> pass_high;
+    std::vector<float> amp;
+    std::vector<float> channel;
+    std::vector<float> oscillator;
+    std::vector<float> weights;
+    int addEnvelope(SegmentEnvelope*);
+    void addOscillator(const char*, void (*)(const float*, float*, int), float, SegmentEnvelope*, float);
+    void addSample(const char*, SegmentEnvelope*, float);
+    int findLane(int) const;
+    int stealLane() const;
+    void triggerLane(int, int, float, int);
+    void moveLane(int, int);
+    void clearLane(int);
+    void enterChain(EnvelopeLanes&, int, int);
+    void enterRelease(EnvelopeLanes&, int);
+    void advanceEnvelope(EnvelopeLanes&, int);
+    void renderEnvelope(EnvelopeLanes&, float*, int, int);
+    bool isSounding(int) const;
+  public:
+    SoaEngine(int, VoicePool::StealPolicy=VoicePool::STEAL_OLDEST);
+    ~SoaEngine();
+    void noteOn(int, float, int);
+    void noteOff(int);
+    void render(const ControllerLane&, const ControllerLane&, const ControllerLane&, const ControllerLane&, const ControllerLane&, float*, int, int);
+    void retireSilent();
+    int getActive() const { return active; }
+    int getPolyphony() const { return polyphony; }
+    void setSampleRate(int);
+    void setBufferSize(int);
+};
+
+#endif // JACK_MIDI_SYNTH_SOA_ENGINE_H
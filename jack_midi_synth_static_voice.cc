@@ -0,0 +1,16 @@
+#include "jack_midi_synth_static_voice.h"
+
+
+DefaultStaticVoice* newDefaultStaticVoice() {
+  return new DefaultStaticVoice(
+    LADSR(0.06, 0.25, 0.9, 1.5, 0.01),
+    std::make_tuple(
+      StaticSlot<Audio, LADSR>(Audio("test.wav"),  LADSR(0.1, 0.5, 0.9, 3.0), 0.8),               // Sample
+      StaticSlot<Sine, LADSR>(Sine(2.0),           LADSR(0.06, 0.15, 0.8,  1.0, 0.015), 0.2),     // Sub
+      StaticSlot<Triangle, LADSR>(Triangle(-1.0),  LADSR(0.06, 0.2,  0.65, 0.9, 0.015), 0.1),     // Sub fifth
+      StaticSlot<Triangle, LADSR>(Triangle(0.0),   LADSR(0.05, 0.25, 0.5,  0.8, 0.02),  0.7),     // Main
+      StaticSlot<Sine, LADSR>(Sine(7.0/12.0),      LADSR(0.04, 0.2,  0.7,  0.7, 0.02),  0.3),     // Fifth
+      StaticSlot<Sine, LADSR>(Sine(1.0),           LADSR(0.03, 0.15, 0.4,  0.6, 0.02),  0.4),     // Octave
+      StaticSlot<Pulse, LADSR>(Pulse(2.0),         LADSR(0.02, 0.1,  0.3,  0.5, 0.02),  0.05)),   // Octave 2
+    std::make_tuple(Pass()));
+}
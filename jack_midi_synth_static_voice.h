@@ -0,0 +1,174 @@
+#ifndef JACK_MIDI_SYNTH_STATIC_VOICE_H
+#define JACK_MIDI_SYNTH_STATIC_VOICE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <tuple>
+#include <utility>
+
+#include "jack_midi_synth_envelopes.h"
+#include "jack_midi_synth_events.h"
+#include "jack_midi_synth_fast_math.h"
+#include "jack_midi_synth_filters.h"
+#include "jack_midi_synth_oscillators.h"
+#include "jack_midi_synth_profiler.h"
+#include "jack_midi_synth_voice.h"
+
+
+template <class OscillatorType, class EnvelopeType>
+struct StaticSlot {
+  StaticSlot(const OscillatorType& init_oscillator, const EnvelopeType& init_envelope, float init_mix) : oscillator(init_oscillator), envelope(init_envelope), mix(init_mix) {}
+  OscillatorType oscillator;
+  EnvelopeType envelope;
+  float mix;
+};
+
+
+template <class Tuple, class Function, std::size_t... Index>
+inline void forEachIndexed(Tuple& tuple, Function& function, std::index_sequence<Index...>) {
+  int expand[] = {0, (function(std::get<Index>(tuple)), 0)...};
+  (void)expand;
+}
+
+template <class... Types, class Function>
+inline void forEach(std::tuple<Types...>& tuple, Function function) {
+  forEachIndexed(tuple, function, std::index_sequence_for<Types...>());
+}
+
+
+// A voice whose patch is fixed by its template arguments: an amp envelope,
+// a tuple of StaticSlots and a tuple of filters, all held by value. Every
+// call below is on a member of a known concrete type, so the compiler can
+// resolve it statically, and the slot and filter loops are unrolled at
+// compile time. Each filter runs over the whole block after the
+// oscillators, through its block process, as in Voice.
+template <class AmpEnvelope, class Slots, class Filters>
+class StaticVoice : public VoiceBase {
+  private:
+    AmpEnvelope envelope;
+    Slots slots;
+    Filters filters;
+    void updateFilter(Pass& filter) {
+      filter.setParameter(Pass::PARAMETER_CUTOFF, 1.0f - getAftertouch());
+      filter.setParameter(Pass::PARAMETER_RESONANCE, getAftertouch());
+    }
+    template <class FilterType>
+    void updateFilter(FilterType&) {}
+  public:
+    StaticVoice(const AmpEnvelope& init_envelope, const Slots& init_slots, const Filters& init_filters) : envelope(init_envelope), slots(init_slots), filters(init_filters) {
+      int slot_index = 0;
+      forEach(slots, [&](auto& slot) {
+        if (slot_index < kMaxProfiledOscillators) PROFILE_NAME(PROFILE_OSCILLATOR + slot_index, "oscillator", slot.oscillator.type);
+        ++slot_index;
+      });
+      int filter_index = 0;
+      forEach(filters, [&](auto& filter) {
+        if (filter_index < kMaxProfiledFilters) PROFILE_NAME(PROFILE_FILTER + filter_index, "filter", filter.type);
+        ++filter_index;
+      });
+    }
+
+    virtual bool isSounding() override {
+      bool sounding = envelope.isSounding();
+      forEach(slots, [&](auto& slot) { sounding = sounding || slot.envelope.isSounding(); });
+      return sounding;
+    }
+
+    virtual float getLevel() const override {
+      return velocity * envelope.getLevel();
+    }
+
+    virtual void triggerVoice(int new_note, float new_velocity, int first_frame) override {
+      VoiceBase::triggerVoice(new_note, new_velocity, first_frame);
+      envelope.pushDown();
+      forEach(slots, [](auto& slot) {
+        slot.envelope.pushDown();
+        slot.oscillator.reset();
+      });
+    }
+
+    virtual void releaseVoice() override {
+      VoiceBase::releaseVoice();
+      envelope.liftUp();
+      forEach(slots, [](auto& slot) { slot.envelope.liftUp(); });
+    }
+
+    virtual void stopVoice() override {
+      forEach(slots, [](auto& slot) { slot.oscillator.stop(); });
+    }
+
+    virtual void update(const ControllerLane* new_bend, const ControllerLane* new_bend_freq, const ControllerLane* new_mod_wheel, const ControllerLane* new_expression, const ControllerLane* new_aftertouch, const ControllerLane* new_sustain) override {
+      VoiceBase::update(new_bend, new_bend_freq, new_mod_wheel, new_expression, new_aftertouch, new_sustain);
+      bool pedal = getPedal();
+      float pulse_centre = getPulseCentre();
+      envelope.setPedal(pedal);
+      forEach(slots, [&](auto& slot) {
+        slot.envelope.setPedal(pedal);
+        slot.oscillator.setFloatParameter(PitchedOscillator::PARAMETER_PULSE_CENTRE, pulse_centre);
+      });
+      forEach(filters, [&](auto& filter) { updateFilter(filter); });
+    }
+
+    virtual void render(float* out, float* send, int global_frame, int length) override {
+      float voice_channel[length];
+      float phase_steps[length];
+      float voice_weights[length];
+      float oscillator_weights[length];
+      float oscillator_channel[length];
+      memset(voice_channel, 0, sizeof(voice_channel));
+      float phase_step;
+      bool steady = fillPhaseSteps(phase_steps, phase_step, length);
+      int first_frame = getFirstFrame(global_frame, length);
+      {
+        PROFILE_SCOPE(PROFILE_ENVELOPES);
+        renderEnvelope(envelope, voice_weights, first_frame, length);
+      }
+      scaleVoiceWeights(voice_weights, length);
+      int slot_index = 0;
+      forEach(slots, [&](auto& slot) {
+        {
+          PROFILE_SCOPE(PROFILE_OSCILLATOR + std::min(slot_index++, kMaxProfiledOscillators - 1));
+          if (steady) slot.oscillator.renderSteady(phase_step, oscillator_channel, length);
+          else slot.oscillator.render(phase_steps, oscillator_channel, length);
+        }
+        {
+          PROFILE_SCOPE(PROFILE_ENVELOPES);
+          renderEnvelope(slot.envelope, oscillator_weights, first_frame, length);
+        }
+        for (int frame=0; frame < length; ++frame) {
+          voice_channel[frame] += voice_weights[frame] * slot.mix * oscillator_weights[frame] * oscillator_channel[frame];
+        }
+      });
+      int filter_index = 0;
+      forEach(filters, [&](auto& filter) {
+        PROFILE_SCOPE(PROFILE_FILTER + std::min(filter_index++, kMaxProfiledFilters - 1));
+        filter.process(voice_channel, length);
+      });
+      PROFILE_SCOPE(PROFILE_VOICE_TANH);
+      mixVoice(voice_channel, out, send, length);
+    }
+
+    virtual void setSampleRate(int rate) override {
+      VoiceBase::setSampleRate(rate);
+      envelope.setSampleRate(rate);
+      forEach(slots, [&](auto& slot) { slot.envelope.setSampleRate(rate); });
+      forEach(filters, [&](auto& filter) { filter.setSampleRate(rate); });
+    }
+};
+
+
+// Voice::Voice's patch as a StaticVoice.
+typedef StaticVoice<LADSR,
+                    std::tuple<StaticSlot<Audio, LADSR>,
+                               StaticSlot<Sine, LADSR>,
+                               StaticSlot<Triangle, LADSR>,
+                               StaticSlot<Triangle, LADSR>,
+                               StaticSlot<Sine, LADSR>,
+                               StaticSlot<Sine, LADSR>,
+                               StaticSlot<Pulse, LADSR> >,
+                    std::tuple<Pass> > DefaultStaticVoice;
+
+DefaultStaticVoice* newDefaultStaticVoice();
+
+#endif // JACK_MIDI_SYNTH_STATIC_VOICE_H
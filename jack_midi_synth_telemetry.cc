@@ -0,0 +1,78 @@
+#include <iomanip>
+#include <algorithm>
+
+#include "jack_midi_synth_disk_streamer.h"
+#include "jack_midi_synth_telemetry.h"
+
+
+// Enough for several seconds of 64 frame periods between drains.
+const int kCycleCapacity = 8192;
+
+
+Histogram::Histogram(float range, int bin_count) : bins(bin_count + 1, 0), bin_width(range / bin_count), count(0), maximum(0.0) {}
+
+void Histogram::add(float value) {
+  int bin = std::min(static_cast<int>(std::max(value, 0.0f) / bin_width), static_cast<int>(bins.size()) - 1);
+  ++bins[bin];
+  ++count;
+  maximum = std::max(maximum, value);
+}
+
+void Histogram::reset() {
+  std::fill(bins.begin(), bins.end(), 0);
+  count = 0;
+  maximum = 0.0;
+}
+
+float Histogram::percentile(float fraction) const {
+  long wanted = static_cast<long>(fraction * count);
+  long seen = 0;
+  for (int bin=0; bin < bins.size(); ++bin) {
+    seen += bins[bin];
+    if (seen > wanted) return std::min((bin + 1) * bin_width, maximum);
+  }
+  return maximum;
+}
+
+
+Telemetry::Telemetry() : cycles(kCycleCapacity), xruns(0), dropped(0), load(2.0, 1000), reported_xruns(0), reported_dropped(0), reported_underruns(0), voice_total(0.0), voice_maximum(0), period(0.0) {}
+
+void Telemetry::recordCycle(float seconds, float cycle_period, int active_voices) {
+  CycleStats stats = {seconds, cycle_period, active_voices};
+  if (!cycles.push(stats)) dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Telemetry::drain() {
+  CycleStats stats;
+  while (cycles.pop(stats)) {
+    load.add(stats.seconds / stats.period);
+    voice_total += stats.active_voices;
+    voice_maximum = std::max(voice_maximum, stats.active_voices);
+    period = stats.period;
+  }
+}
+
+void Telemetry::report(std::ostream& out) {
+  drain();
+  long total_xruns = xruns.load(std::memory_order_relaxed);
+  long total_dropped = dropped.load(std::memory_order_relaxed);
+  long total_underruns = DiskStreamer::getUnderruns();
+  out << std::fixed << std::setprecision(1);
+  out << "telemetry: " << load.getCount() << " cycles, " << total_xruns - reported_xruns << " xruns (" << total_xruns << " total)";
+  if (total_dropped > reported_dropped) out << ", " << total_dropped - reported_dropped << " cycles not recorded";
+  if (total_underruns > 0) out << ", " << total_underruns - reported_underruns << " stream underruns (" << total_underruns << " total)";
+  out << std::endl;
+  if (load.getCount() > 0) {
+    out << "  load ";
+    for (float fraction: {0.5f, 0.9f, 0.99f, 0.999f}) out << "  p" << fraction * 100 << " " << 100.0 * load.percentile(fraction) << "%";
+    out << "  max " << 100.0 * load.getMaximum() << "% of " << period * 1e6 << "us" << std::endl;
+    out << "  voices  mean " << voice_total / load.getCount() << "  max " << voice_maximum << std::endl;
+  }
+  out.flush();
+  reported_xruns = total_xruns;
+  reported_dropped = total_dropped;
+  reported_underruns = total_underruns;
+  load.reset();
+  voice_total = 0.0;
+  voice_maximum = 0;
+}
@@ -0,0 +1,59 @@
+#ifndef JACK_MIDI_SYNTH_TELEMETRY_H
+#define JACK_MIDI_SYNTH_TELEMETRY_H
+
+#include <atomic>
+#include <ostream>
+#include <vector>
+
+#include "jack_midi_synth_ring_buffer.h"
+
+struct CycleStats {
+  float seconds;
+  float period;
+  int active_voices;
+};
+
+
+class Histogram {
+  private:
+    std::vector<long> bins;
+    float bin_width;
+    long count;
+    float maximum;
+  public:
+    Histogram(float, int);
+    void add(float);
+    void reset();
+    long getCount() const { return count; }
+    float getMaximum() const { return maximum; }
+    float percentile(float) const;
+};
+
+
+// The process thread records one CycleStats per period into a lock-free
+// ring, and xruns into an atomic counter. A non-real-time thread drains
+// the ring into histograms and periodically reports percentiles of the DSP
+// load, so nothing on the process thread allocates, locks or formats text.
+// Disk stream underruns are counted by the DiskStreamer and reported here
+// once there have been any.
+class Telemetry {
+  private:
+    RingBuffer<CycleStats> cycles;
+    std::atomic<long> xruns;
+    std::atomic<long> dropped;
+    Histogram load;
+    long reported_xruns;
+    long reported_dropped;
+    long reported_underruns;
+    double voice_total;
+    int voice_maximum;
+    float period;
+  public:
+    Telemetry();
+    void recordCycle(float, float, int);
+    void recordXrun() { xruns.fetch_add(1, std::memory_order_relaxed); }
+    void drain();
+    void report(std::ostream&);
+};
+
+#endif // JACK_MIDI_SYNTH_TELEMETRY_H
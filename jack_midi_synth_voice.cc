@@ -2,26 +2,143 @@
 #include "jack_midi_synth_envelopes.h"
 #include "jack_midi_synth_oscillators.h"
 #include "jack_midi_synth_filters.h"
+#include "jack_midi_synth_patch.h"
 #include "jack_midi_synth_events.h"
+#include "jack_midi_synth_fast_math.h"
+#include "jack_midi_synth_profiler.h"
 
+#include <algorithm>
 #include <cstring>
 #include <cmath>
 
 
-Voice::Voice(int note) {
+VoiceBase::VoiceBase() : note(0), velocity(0.0), released(true), bend(nullptr), bend_freq(nullptr), mod_wheel(nullptr), expression(nullptr), sustain(nullptr), aftertouch(nullptr), trigger_frame(0), sample_rate(48000), buffer_size(0), send_level(0.0) {
   pitch = freq(note);
-  trigger_frame = 0;
-  velocity = 0.0;
-  envelope = new LADSR(0.06, 0.25, 0.9, 1.5, 0.01);
-  osc_env_mixes.push_back(OscEnvMix(new Audio("test.wav"), new LADSR(0.1, 0.5, 0.9, 3.0), 0.8));            // Sample
-  osc_env_mixes.push_back(OscEnvMix(new Sine(2.0),         new LADSR(0.06, 0.15, 0.8,  1.0, 0.015), 0.2));  // Sub
-  osc_env_mixes.push_back(OscEnvMix(new Triangle(-1.0),    new LADSR(0.06, 0.2,  0.65, 0.9, 0.015), 0.1));  // Sub fifth
-  osc_env_mixes.push_back(OscEnvMix(new Triangle(0.0),     new LADSR(0.05, 0.25, 0.5,  0.8, 0.02),  0.7));  // Main
-  osc_env_mixes.push_back(OscEnvMix(new Sine(7.0/12.0),    new LADSR(0.04, 0.2,  0.7,  0.7, 0.02),  0.3));  // Fifth
-  osc_env_mixes.push_back(OscEnvMix(new Sine(1.0),         new LADSR(0.03, 0.15, 0.4,  0.6, 0.02),  0.4));  // Octave
-  osc_env_mixes.push_back(OscEnvMix(new Pulse(2.0),        new LADSR(0.02, 0.1,  0.3,  0.5, 0.02),  0.05)); // Octave 2
-  filters.push_back(new Pass);
-  filters.push_back(new Delay(0.1, 0.7));
+}
+
+void VoiceBase::triggerVoice(int new_note, float new_velocity, int first_frame) {
+  note = new_note;
+  pitch = freq(note);
+  velocity = new_velocity;
+  released = false;
+  trigger_frame = first_frame;
+}
+
+void VoiceBase::releaseVoice() {
+  released = true;
+}
+
+void VoiceBase::update(const ControllerLane* new_bend, const ControllerLane* new_bend_freq, const ControllerLane* new_mod_wheel, const ControllerLane* new_expression, const ControllerLane* new_aftertouch, const ControllerLane* new_sustain) {
+  bend = new_bend;
+  bend_freq = new_bend_freq;
+  mod_wheel = new_mod_wheel;
+  expression = new_expression;
+  aftertouch = new_aftertouch;
+  sustain = new_sustain;
+}
+
+bool VoiceBase::getPedal() const {
+  return (*sustain)[sustain->size()/2];
+}
+
+float VoiceBase::getPulseCentre() const {
+  return 0.5 + (*mod_wheel)[mod_wheel->size()/2]*0.5;
+}
+
+float VoiceBase::getAftertouch() const {
+  return (*aftertouch)[aftertouch->size()/2];
+}
+
+// Fills phase_steps only when the bend moves this period; otherwise the
+// single phase_step is all the oscillators need. Returns whether it was
+// steady.
+bool VoiceBase::fillPhaseSteps(float* phase_steps, float& phase_step, int length) const {
+  float raw_freq = pitch / sample_rate;
+  phase_step = bend_freq->getValue() * raw_freq;
+  if (bend_freq->isConstant()) return true;
+  for (int frame=0; frame < length; ++frame) phase_steps[frame] = (*bend_freq)[frame] * raw_freq;
+  return false;
+}
+
+int VoiceBase::getFirstFrame(int global_frame, int length) const {
+  return std::min(std::max(trigger_frame - global_frame, 0), length);
+}
+
+void VoiceBase::scaleVoiceWeights(float* voice_weights, int length) const {
+  if (expression->isConstant() && aftertouch->isConstant()) {
+    double scale = expression->getValue() * velocity * (1.0 + aftertouch->getValue());
+    for (int frame=0; frame < length; ++frame) voice_weights[frame] *= scale;
+  } else {
+    for (int frame=0; frame < length; ++frame) {
+      voice_weights[frame] *= (*expression)[frame] * velocity * (1.0 + (*aftertouch)[frame]);
+    }
+  }
+}
+
+// Saturates the voice and splits it between the dry output and the send.
+void VoiceBase::mixVoice(const float* voice_channel, float* out, float* send, int length) const {
+  if (send_level == 0.0f) {
+    for (int frame=0; frame < length; ++frame) out[frame] += fastTanh(voice_channel[frame]);
+  } else {
+    float dry_level = 1.0f - send_level;
+    for (int frame=0; frame < length; ++frame) {
+      float value = fastTanh(voice_channel[frame]);
+      out[frame] += dry_level * value;
+      send[frame] += send_level * value;
+    }
+  }
+}
+
+float VoiceBase::freq(int note) const {
+  return fastExp2((note - 69.0f) / 12.0f) * 440.0f;
+}
+
+void VoiceBase::setSampleRate(int rate) {
+  sample_rate = rate;
+}
+
+void VoiceBase::setBufferSize(int size) {
+  buffer_size = size;
+}
+
+
+Voice::Voice() : Voice(Patch::getDefault()) {}
+
+Voice::Voice(const Patch& patch) : envelope(nullptr) {
+  const std::vector<PatchOp>& ops = patch.getOps();
+  int oscillators = 0;
+  int filter_count = 0;
+  for (auto& op: ops) {
+    oscillators += op.code == PatchOp::OP_OSCILLATOR;
+    filter_count += op.code == PatchOp::OP_FILTER;
+  }
+  osc_env_mixes.reserve(oscillators);
+  filters.reserve(filter_count);
+  for (int i=0; i < ops.size(); ++i) {
+    const PatchOp& op = ops[i];
+    if (op.code == PatchOp::OP_OSCILLATOR) {
+      osc_env_mixes.push_back(OscEnvMix(patch.newOscillator(op), patch.newEnvelope(ops[++i]), patch.getParameter(op, 0)));
+    } else if (op.code == PatchOp::OP_ENVELOPE) {
+      envelope = patch.newEnvelope(op);
+    } else if (op.code == PatchOp::OP_EFFECT) {
+      continue;
+    } else if (i + 1 < ops.size() && ops[i + 1].code == PatchOp::OP_ENVELOPE) {
+      filters.push_back(FilterEnvMod(patch.newFilter(op), patch.newEnvelope(ops[i + 1]), patch.getParameter(op, op.count - 1)));
+      ++i;
+    } else {
+      filters.push_back(FilterEnvMod(patch.newFilter(op), nullptr, 0.0));
+    }
+  }
+  int slot = 0;
+  for (auto& osc_env_mix: osc_env_mixes) {
+    if (slot < kMaxProfiledOscillators) PROFILE_NAME(PROFILE_OSCILLATOR + slot, "oscillator", osc_env_mix.oscillator->type);
+    ++slot;
+  }
+  slot = 0;
+  for (auto& filter: filters) {
+    if (slot < kMaxProfiledFilters) PROFILE_NAME(PROFILE_FILTER + slot, "filter", filter.filter->type);
+    ++slot;
+  }
 }
 
 Voice::~Voice() {
@@ -30,7 +147,10 @@ Voice::~Voice() {
     delete osc_env_mix.oscillator;
     delete osc_env_mix.envelope;
   }
-  for (auto& filter: filters) delete filter;
+  for (auto& filter: filters) {
+    delete filter.filter;
+    delete filter.envelope;
+  }
 }
 
 bool Voice::isSounding() {
@@ -43,70 +163,106 @@ bool Voice::isSounding() {
   return false;
 }
 
-void Voice::triggerVoice(float new_velocity, int first_frame) {
-  velocity = new_velocity;
-  trigger_frame = first_frame;
+float Voice::getLevel() const {
+  return velocity * envelope->getLevel();
+}
+
+void Voice::triggerVoice(int new_note, float new_velocity, int first_frame) {
+  VoiceBase::triggerVoice(new_note, new_velocity, first_frame);
   envelope->pushDown();
   for (auto& osc_env_mix: osc_env_mixes) {
     osc_env_mix.envelope->pushDown();
-    osc_env_mix.oscillator->reset();
+    osc_env_mix.oscillator->trigger(new_note, new_velocity);
+  }
+  for (auto& filter: filters) {
+    if (filter.envelope) filter.envelope->pushDown();
   }
 }
 
 void Voice::releaseVoice() {
+  VoiceBase::releaseVoice();
   envelope->liftUp();
   for (auto& osc_env_mix: osc_env_mixes) osc_env_mix.envelope->liftUp();
+  for (auto& filter: filters) {
+    if (filter.envelope) filter.envelope->liftUp();
+  }
 }
 
-void Voice::update(const std::vector<float>* new_bend, const std::vector<float>* new_bend_freq, const std::vector<float>* new_mod_wheel, const std::vector<float>* new_expression, const std::vector<float>* new_aftertouch, const std::vector<float>* new_sustain) {
-  bend = new_bend;
-  bend_freq = new_bend_freq;
-  mod_wheel = new_mod_wheel;
-  expression = new_expression;
-  aftertouch = new_aftertouch;
-  sustain = new_sustain;
-  bool pedal = (*sustain)[sustain->size()/2];
+void Voice::stopVoice() {
+  for (auto& osc_env_mix: osc_env_mixes) osc_env_mix.oscillator->stop();
+}
+
+void Voice::update(const ControllerLane* new_bend, const ControllerLane* new_bend_freq, const ControllerLane* new_mod_wheel, const ControllerLane* new_expression, const ControllerLane* new_aftertouch, const ControllerLane* new_sustain) {
+  VoiceBase::update(new_bend, new_bend_freq, new_mod_wheel, new_expression, new_aftertouch, new_sustain);
+  bool pedal = getPedal();
   envelope->setPedal(pedal);
   for (auto& osc_env_mix: osc_env_mixes) osc_env_mix.envelope->setPedal(pedal);
-  for (auto& osc_env_mix: osc_env_mixes) osc_env_mix.oscillator->setFloatParameter(PitchedOscillator::PARAMETER_PULSE_CENTRE, 0.5 + (*mod_wheel)[mod_wheel->size()/2]*0.5);
-  for (auto filter: filters) {
-    if (strcmp(filter->type, "Pass") == 0) filter->setParameter(Pass::PARAMETER_CUTOFF, 1.0f - (*aftertouch)[aftertouch->size()/2]);
-    if (strcmp(filter->type, "Pass") == 0) filter->setParameter(Pass::PARAMETER_RESONANCE, (*aftertouch)[aftertouch->size()/2]);
+  for (auto& filter: filters) {
+    if (filter.envelope) filter.envelope->setPedal(pedal);
   }
+  for (auto& osc_env_mix: osc_env_mixes) osc_env_mix.oscillator->setFloatParameter(PitchedOscillator::PARAMETER_PULSE_CENTRE, getPulseCentre());
 }
 
-void Voice::render(float* out, int global_frame, int length) {
-  float raw_freq = pitch / sample_rate;
+void Voice::render(float* out, float* send, int global_frame, int length) {
   float voice_channel[length];
+  float phase_steps[length];
+  float voice_weights[length];
+  float oscillator_weights[length];
+  float oscillator_channel[length];
   memset(voice_channel, 0, sizeof(voice_channel));
+  float phase_step;
+  bool steady = fillPhaseSteps(phase_steps, phase_step, length);
+  int first_frame = getFirstFrame(global_frame, length);
+  {
+    PROFILE_SCOPE(PROFILE_ENVELOPES);
+    renderEnvelope(*envelope, voice_weights, first_frame, length);
+  }
+  scaleVoiceWeights(voice_weights, length);
+  int slot = 0;
   for (auto& osc_env_mix: osc_env_mixes) {
-    for (int frame=0; frame < length; ++frame) {
-      float freq = (*bend_freq)[frame] * raw_freq;
-      int frames_since_trigger = frame + global_frame - trigger_frame;
-      float time_since_trigger = static_cast<float>(frames_since_trigger) / sample_rate;
-      float voice_weight = (*expression)[frame] * velocity * envelope->getWeight(time_since_trigger);
-      voice_channel[frame] += voice_weight * (osc_env_mix.mix * (1.0 + (*aftertouch)[frame])) * osc_env_mix.envelope->getWeight(time_since_trigger) * osc_env_mix.oscillator->getAmplitude(freq);
+    {
+      PROFILE_SCOPE(PROFILE_OSCILLATOR + std::min(slot++, kMaxProfiledOscillators - 1));
+      if (steady) osc_env_mix.oscillator->renderSteady(phase_step, oscillator_channel, length);
+      else osc_env_mix.oscillator->render(phase_steps, oscillator_channel, length);
+    }
+    {
+      PROFILE_SCOPE(PROFILE_ENVELOPES);
+      renderEnvelope(*osc_env_mix.envelope, oscillator_weights, first_frame, length);
     }
-  }
-  for (auto& filter: filters) {
     for (int frame=0; frame < length; ++frame) {
-      filter->process(voice_channel[frame]);
+      voice_channel[frame] += voice_weights[frame] * osc_env_mix.mix * oscillator_weights[frame] * oscillator_channel[frame];
     }
   }
+  // Aftertouch closes the cutoff and raises the resonance; a filter's own
+  // envelope adds to its cutoff on top of that.
+  float cutoff_offsets[length];
+  float resonance_offsets[length];
+  float swept_offsets[length];
   for (int frame=0; frame < length; ++frame) {
-    out[frame] += tanh(voice_channel[frame]);
+    cutoff_offsets[frame] = -(*aftertouch)[frame];
+    resonance_offsets[frame] = (*aftertouch)[frame];
   }
-}
-
-float Voice::freq(int note) const {
-  return pow(2.0f, ((note - 69.0) / 12.0)) * 440.0;
+  slot = 0;
+  for (auto& filter: filters) {
+    PROFILE_SCOPE(PROFILE_FILTER + std::min(slot++, kMaxProfiledFilters - 1));
+    if (filter.envelope) {
+      renderEnvelope(*filter.envelope, swept_offsets, first_frame, length);
+      for (int frame=0; frame < length; ++frame) swept_offsets[frame] = cutoff_offsets[frame] + filter.amount * swept_offsets[frame];
+      filter.filter->processModulated(voice_channel, swept_offsets, resonance_offsets, length);
+    } else {
+      filter.filter->processModulated(voice_channel, cutoff_offsets, resonance_offsets, length);
+    }
+  }
+  PROFILE_SCOPE(PROFILE_VOICE_TANH);
+  mixVoice(voice_channel, out, send, length);
 }
 
 void Voice::setSampleRate(int rate) {
-  sample_rate = rate;
-  for (auto& filter: filters) filter->setSampleRate(rate);
-}
-
-void Voice::setBufferSize(int size) {
-  buffer_size = size;
+  VoiceBase::setSampleRate(rate);
+  envelope->setSampleRate(rate);
+  for (auto& osc_env_mix: osc_env_mixes) osc_env_mix.envelope->setSampleRate(rate);
+  for (auto& filter: filters) {
+    filter.filter->setSampleRate(rate);
+    if (filter.envelope) filter.envelope->setSampleRate(rate);
+  }
 }
@@ -5,9 +5,9 @@ class Envelope;
 class Oscillator;
 class Filter;
 
-struct FloatEvent;
+class ControllerLane;
+class Patch;
 
-#include <list>
 #include <vector>
 
 #include "jack_midi_synth_envelopes.h"
@@ -19,33 +19,88 @@ struct OscEnvMix {
   float mix;
 };
 
-class Voice {
-  private:
+// A filter and the optional envelope that sweeps its cutoff, by amount at
+// full level.
+struct FilterEnvMod {
+  FilterEnvMod(Filter* init_filter, Envelope* init_envelope, float init_amount) : filter(init_filter), envelope(init_envelope), amount(init_amount) {}
+  Filter* filter;
+  Envelope* envelope;
+  float amount;
+};
+
+// The state and helpers shared by every kind of voice. VoicePool and
+// WorkerPool only see this interface, so a voice can either be assembled
+// at run time from heap objects (Voice) or be a fixed patch compiled as a
+// template (StaticVoice).
+class VoiceBase {
+  protected:
+    int note;
     float pitch;
     float velocity;
-    const std::vector<float>* bend;
-    const std::vector<float>* bend_freq;
-    const std::vector<float>* mod_wheel;
-    const std::vector<float>* expression;
-    const std::vector<float>* sustain;
-    const std::vector<float>* aftertouch;
-    std::list<Filter*> filters;
-    Envelope* envelope;
-    std::list<OscEnvMix> osc_env_mixes;
+    bool released;
+    const ControllerLane* bend;
+    const ControllerLane* bend_freq;
+    const ControllerLane* mod_wheel;
+    const ControllerLane* expression;
+    const ControllerLane* sustain;
+    const ControllerLane* aftertouch;
     int trigger_frame;
     int sample_rate;
     int buffer_size;
+    float send_level;
+    bool fillPhaseSteps(float*, float&, int) const;
+    int getFirstFrame(int, int) const;
+    void scaleVoiceWeights(float*, int) const;
+    void mixVoice(const float*, float*, float*, int) const;
+    bool getPedal() const;
+    float getPulseCentre() const;
+    float getAftertouch() const;
+    template <class EnvelopeType>
+    static void renderEnvelope(EnvelopeType& this_envelope, float* weights, int first_frame, int length) {
+      for (int frame=0; frame < first_frame; ++frame) weights[frame] = 0.0;
+      this_envelope.render(weights + first_frame, length - first_frame);
+    }
   public:
-    Voice(int);
-    ~Voice();
-    bool isSounding();
-    void triggerVoice(float, int);
-    void releaseVoice();
-    void update(const std::vector<float>*, const std::vector<float>*, const std::vector<float>*, const std::vector<float>*, const std::vector<float>*, const std::vector<float>*);
-    void render(float*, int, int);
+    VoiceBase();
+    virtual ~VoiceBase() {}
+    virtual bool isSounding() = 0;
+    bool isReleased() const { return released; }
+    int getNote() const { return note; }
+    virtual float getLevel() const = 0;
+    virtual void triggerVoice(int, float, int);
+    virtual void releaseVoice();
+    // Called as the voice goes back to its program's free list.
+    virtual void stopVoice() {}
+    virtual void update(const ControllerLane*, const ControllerLane*, const ControllerLane*, const ControllerLane*, const ControllerLane*, const ControllerLane*);
+    // Adds the voice into out, less the share it adds into send for the
+    // effect bus.
+    virtual void render(float*, float*, int, int) = 0;
     float freq(int) const;
-    void setSampleRate(int);
+    virtual void setSampleRate(int);
     void setBufferSize(int);
+    void setSendLevel(float new_send_level) { send_level = new_send_level; }
+};
+
+
+// A voice assembled at run time by walking a Patch's ops, with its
+// components held in op order.
+class Voice : public VoiceBase {
+  private:
+    std::vector<FilterEnvMod> filters;
+    Envelope* envelope;
+    std::vector<OscEnvMix> osc_env_mixes;
+  public:
+    Voice();
+    Voice(const Patch&);
+    ~Voice();
+    virtual bool isSounding() override;
+    virtual float getLevel() const override;
+    virtual void triggerVoice(int, float, int) override;
+    virtual void releaseVoice() override;
+    virtual void stopVoice() override;
+    virtual void update(const ControllerLane*, const ControllerLane*, const ControllerLane*, const ControllerLane*, const ControllerLane*, const ControllerLane*) override;
+    virtual void render(float*, float*, int, int) override;
+    virtual void setSampleRate(int) override;
 };
 
 #endif // JACK_MIDI_SYNTH_VOICE_H
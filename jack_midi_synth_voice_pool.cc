@@ -0,0 +1,105 @@
+#include "jack_midi_synth_voice_pool.h"
+
+#include "jack_midi_synth_render_program.h"
+#include "jack_midi_synth_voice.h"
+
+
+VoicePool::VoicePool(RenderProgram* init_program, StealPolicy init_policy) : polyphony(init_program->getPolyphony()), program(init_program), policy(init_policy) {
+  retiring_programs.reserve(kMaxRetiringPrograms);
+  active_voices.reserve(polyphony);
+  active_programs.reserve(polyphony);
+}
+
+VoicePool::~VoicePool() {
+  for (auto retiring: retiring_programs) delete retiring;
+}
+
+int VoicePool::findVoice(int note) {
+  for (int i=0; i < active_voices.size(); ++i) {
+    if (active_voices[i]->getNote() == note && !active_voices[i]->isReleased()) return i;
+  }
+  return -1;
+}
+
+void VoicePool::stealVoice() {
+  int victim = 0;
+  if (policy == STEAL_QUIETEST) {
+    float quietest = active_voices[0]->getLevel();
+    for (int i=1; i < active_voices.size(); ++i) {
+      float level = active_voices[i]->getLevel();
+      if (level < quietest) {
+        quietest = level;
+        victim = i;
+      }
+    }
+  }
+  active_programs[victim]->release(active_voices[victim]);
+  deactivate(victim);
+}
+
+void VoicePool::deactivate(int index) {
+  active_voices.erase(active_voices.begin() + index);
+  active_programs.erase(active_programs.begin() + index);
+}
+
+// The current program always has a voice free once the pool is below
+// polyphony, since it can own at most every active voice.
+VoiceBase* VoicePool::noteOn(int note, float velocity, int first_frame) {
+  int index = findVoice(note);
+  VoiceBase* voice = nullptr;
+  if (index >= 0 && policy == STEAL_SAME_NOTE && active_programs[index] == program) {
+    voice = active_voices[index];
+    deactivate(index);
+  } else {
+    if (index >= 0 && policy == STEAL_SAME_NOTE) {
+      active_programs[index]->release(active_voices[index]);
+      deactivate(index);
+    } else if (index >= 0) {
+      active_voices[index]->releaseVoice();
+    }
+    if (active_voices.size() >= polyphony) stealVoice();
+    voice = program->acquire();
+  }
+  voice->triggerVoice(note, velocity, first_frame);
+  active_voices.push_back(voice);
+  active_programs.push_back(program);
+  return voice;
+}
+
+void VoicePool::noteOff(int note) {
+  for (auto voice: active_voices) {
+    if (voice->getNote() == note && !voice->isReleased()) voice->releaseVoice();
+  }
+}
+
+void VoicePool::retireSilent() {
+  for (int i=active_voices.size() - 1; i >= 0; --i) {
+    if (!active_voices[i]->isSounding()) {
+      active_programs[i]->release(active_voices[i]);
+      deactivate(i);
+    }
+  }
+}
+
+// Hands back a replaced program none of whose voices are still sounding,
+// for the caller to delete off the process thread.
+RenderProgram* VoicePool::takeIdleProgram() {
+  for (int i=0; i < retiring_programs.size(); ++i) {
+    RenderProgram* retiring = retiring_programs[i];
+    if (retiring->isIdle()) {
+      retiring_programs.erase(retiring_programs.begin() + i);
+      return retiring;
+    }
+  }
+  return nullptr;
+}
+
+// The current program belongs to the caller, which updates it with the
+// rest of its programs; these only reach the ones being retired.
+void VoicePool::setSampleRate(int rate) {
+  for (auto retiring: retiring_programs) retiring->setSampleRate(rate);
+}
+
+void VoicePool::setBufferSize(int size) {
+  for (auto retiring: retiring_programs) retiring->setBufferSize(size);
+}
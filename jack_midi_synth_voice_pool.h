@@ -0,0 +1,54 @@
+#ifndef JACK_MIDI_SYNTH_VOICE_POOL_H
+#define JACK_MIDI_SYNTH_VOICE_POOL_H
+
+#include <vector>
+
+class RenderProgram;
+class VoiceBase;
+
+const int kMaxRetiringPrograms = 8;
+
+// A fixed number of sounding voices shared by all notes. New notes take
+// their voice from the current RenderProgram; sounding voices sit on the
+// active list in the order they were triggered, next to the program they
+// came from, so a voice started before a program change finishes on its
+// old patch. Switching programs is just repointing program. A program
+// that has been replaced for good is handed to the pool to retire, and is
+// kept until its last voice falls silent. Every list is reserved up front
+// so none of this allocates on the process thread.
+class VoicePool {
+  public:
+    enum StealPolicy {
+      STEAL_OLDEST = 0,
+      STEAL_QUIETEST,
+      STEAL_SAME_NOTE,
+      kNumStealPolicies
+    };
+  private:
+    int polyphony;
+    RenderProgram* program;
+    std::vector<RenderProgram*> retiring_programs;
+    std::vector<VoiceBase*> active_voices;
+    std::vector<RenderProgram*> active_programs;
+    StealPolicy policy;
+    int findVoice(int);
+    void stealVoice();
+    void deactivate(int);
+  public:
+    VoicePool(RenderProgram*, StealPolicy=STEAL_OLDEST);
+    ~VoicePool();
+    VoiceBase* noteOn(int, float, int);
+    void noteOff(int);
+    void retireSilent();
+    void setProgram(RenderProgram* new_program) { program = new_program; }
+    bool canRetireProgram() const { return retiring_programs.size() < kMaxRetiringPrograms; }
+    void retireProgram(RenderProgram* old_program) { retiring_programs.push_back(old_program); }
+    RenderProgram* takeIdleProgram();
+    const std::vector<VoiceBase*>& getActive() const { return active_voices; }
+    const std::vector<RenderProgram*>& getActivePrograms() const { return active_programs; }
+    int getPolyphony() const { return polyphony; }
+    void setSampleRate(int);
+    void setBufferSize(int);
+};
+
+#endif // JACK_MIDI_SYNTH_VOICE_POOL_H
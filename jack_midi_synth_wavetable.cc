@@ -0,0 +1,107 @@
+#include "jack_midi_synth_wavetable.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+const double kPi = 3.14159265358979323846;
+
+// The Fourier series of the naive oscillators, phase for phase, so a
+// wavetable saw starts its cycle where Saw does.
+Wavetable::Wavetable(Shape shape) {
+  std::vector<float> cosines(kWavetableSize / 2, 0.0);
+  std::vector<float> sines(kWavetableSize / 2, 0.0);
+  for (int harmonic=1; harmonic < kWavetableSize / 2; ++harmonic) {
+    bool odd = harmonic % 2;
+    switch (shape) {
+      case WAVE_SINE:
+        if (harmonic == 1) sines[harmonic] = 1.0;
+        break;
+      case WAVE_TRIANGLE:
+        if (odd) cosines[harmonic] = -8.0 / (kPi * kPi * harmonic * harmonic);
+        break;
+      case WAVE_SAW:
+        sines[harmonic] = -2.0 / (kPi * harmonic);
+        break;
+      case WAVE_REVERSE_SAW:
+        sines[harmonic] = 2.0 / (kPi * harmonic);
+        break;
+      case WAVE_PULSE:
+        if (odd) sines[harmonic] = -4.0 / (kPi * harmonic);
+        break;
+      default:
+        break;
+    }
+  }
+  build(cosines, sines);
+}
+
+// Takes the whole of cycle as one period, resamples it to the table size,
+// drops the DC and scales the full-band level to a peak of 1.
+Wavetable::Wavetable(const std::vector<float>& cycle) {
+  std::vector<float> resampled(kWavetableSize, 0.0);
+  for (int i=0; i < kWavetableSize && !cycle.empty(); ++i) {
+    double position = static_cast<double>(i) * cycle.size() / kWavetableSize;
+    int index = static_cast<int>(position);
+    double fraction = position - index;
+    float next = cycle[(index + 1) % cycle.size()];
+    resampled[i] = cycle[index] + fraction * (next - cycle[index]);
+  }
+  std::vector<float> cosines(kWavetableSize / 2, 0.0);
+  std::vector<float> sines(kWavetableSize / 2, 0.0);
+  for (int harmonic=1; harmonic < kWavetableSize / 2; ++harmonic) {
+    double cosine = 0.0;
+    double sine = 0.0;
+    for (int i=0; i < kWavetableSize; ++i) {
+      double angle = 2.0 * kPi * ((static_cast<long>(harmonic) * i) % kWavetableSize) / kWavetableSize;
+      cosine += resampled[i] * cos(angle);
+      sine += resampled[i] * sin(angle);
+    }
+    cosines[harmonic] = 2.0 * cosine / kWavetableSize;
+    sines[harmonic] = 2.0 * sine / kWavetableSize;
+  }
+  build(cosines, sines);
+  float peak = 0.0;
+  for (int i=0; i < kWavetableSize; ++i) peak = std::max(peak, std::fabs(levels[i]));
+  if (peak > 0.0) {
+    for (auto& value: levels) value /= peak;
+  }
+}
+
+void Wavetable::build(const std::vector<float>& cosines, const std::vector<float>& sines) {
+  std::vector<double> sine_table(kWavetableSize);
+  for (int i=0; i < kWavetableSize; ++i) sine_table[i] = sin(2.0 * kPi * i / kWavetableSize);
+  levels.assign(kWavetableLevels * (kWavetableSize + 1), 0.0);
+  for (int level=0; level < kWavetableLevels; ++level) {
+    int harmonics = std::min(kWavetableSize / 2 >> level, kWavetableSize / 2 - 1);
+    float* data = levels.data() + level * (kWavetableSize + 1);
+    for (int i=0; i < kWavetableSize; ++i) {
+      double value = 0.0;
+      for (int harmonic=1; harmonic <= harmonics; ++harmonic) {
+        int index = (harmonic * i) & (kWavetableSize - 1);
+        value += sines[harmonic] * sine_table[index] + cosines[harmonic] * sine_table[(index + kWavetableSize / 4) & (kWavetableSize - 1)];
+      }
+      data[i] = value;
+    }
+    data[kWavetableSize] = data[0];
+  }
+}
+
+// The lowest level whose top harmonic stays at or below Nyquist for this
+// phase step (in cycles per sample).
+int Wavetable::getLevel(float phase_step) const {
+  int level = 0;
+  while (level < kWavetableLevels - 1 && (kWavetableSize / 2 >> level) * phase_step > 0.5) ++level;
+  return level;
+}
+
+const Wavetable& Wavetable::get(Shape shape) {
+  static const Wavetable tables[kNumShapes] = {
+    Wavetable(WAVE_SINE),
+    Wavetable(WAVE_TRIANGLE),
+    Wavetable(WAVE_SAW),
+    Wavetable(WAVE_REVERSE_SAW),
+    Wavetable(WAVE_PULSE)
+  };
+  return tables[shape];
+}
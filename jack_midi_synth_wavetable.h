@@ -0,0 +1,36 @@
+#ifndef JACK_MIDI_SYNTH_WAVETABLE_H
+#define JACK_MIDI_SYNTH_WAVETABLE_H
+
+#include <vector>
+
+const int kWavetableSize = 2048;
+const int kWavetableLevels = 11;
+
+// One cycle of a waveform stored once per octave of playback pitch. Level
+// n keeps only the harmonics up to kWavetableSize / 2 >> n, so a note
+// read from the level getLevel picks for its phase step has nothing above
+// Nyquist. Every level is followed by a guard sample repeating its first,
+// so an interpolated read never has to wrap. Tables are built from their
+// harmonics once, off the process thread, and then only ever read.
+class Wavetable {
+  public:
+    enum Shape {
+      WAVE_SINE = 0,
+      WAVE_TRIANGLE,
+      WAVE_SAW,
+      WAVE_REVERSE_SAW,
+      WAVE_PULSE,
+      kNumShapes
+    };
+  private:
+    std::vector<float> levels;
+    void build(const std::vector<float>&, const std::vector<float>&);
+  public:
+    Wavetable(Shape);
+    Wavetable(const std::vector<float>&);
+    int getLevel(float) const;
+    const float* getLevelData(int level) const { return levels.data() + level * (kWavetableSize + 1); }
+    static const Wavetable& get(Shape);
+};
+
+#endif // JACK_MIDI_SYNTH_WAVETABLE_H
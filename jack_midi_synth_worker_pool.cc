@@ -0,0 +1,98 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+
+#include "jack_midi_synth_worker_pool.h"
+#include "jack_midi_synth_voice.h"
+
+
+WorkerPool::WorkerPool(int threads, int priority) : buses(threads + 1), send_buses(threads + 1), running(true), voices(nullptr), global_frame(0), length(0) {
+  sem_init(&done, 0, 0);
+  for (int i=0; i < threads; ++i) {
+    Worker* worker = new Worker;
+    worker->pool = this;
+    worker->participant = i + 1;
+    sem_init(&worker->wake, 0, 0);
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    if (priority > 0) {
+      sched_param parameters;
+      parameters.sched_priority = priority;
+      pthread_attr_setinheritsched(&attributes, PTHREAD_EXPLICIT_SCHED);
+      pthread_attr_setschedpolicy(&attributes, SCHED_FIFO);
+      pthread_attr_setschedparam(&attributes, &parameters);
+    }
+    if (pthread_create(&worker->thread, &attributes, WorkerPool::static_work, worker)) {
+      std::cerr << "Unable to start real-time render thread, using normal priority" << std::endl;
+      pthread_attr_destroy(&attributes);
+      pthread_attr_init(&attributes);
+      if (pthread_create(&worker->thread, &attributes, WorkerPool::static_work, worker)) {
+        std::cerr << "Unable to start render thread" << std::endl;
+        exit(1);
+      }
+    }
+    pthread_attr_destroy(&attributes);
+    workers.push_back(worker);
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  running = false;
+  for (auto worker: workers) sem_post(&worker->wake);
+  for (auto worker: workers) {
+    pthread_join(worker->thread, NULL);
+    sem_destroy(&worker->wake);
+    delete worker;
+  }
+  sem_destroy(&done);
+}
+
+void* WorkerPool::static_work(void* arg) {
+  Worker* worker = reinterpret_cast<Worker*>(arg);
+  worker->pool->work(worker);
+  return NULL;
+}
+
+void WorkerPool::work(Worker* worker) {
+  for (;;) {
+    sem_wait(&worker->wake);
+    if (!running) return;
+    renderShare(worker->participant);
+    sem_post(&done);
+  }
+}
+
+void WorkerPool::renderShare(int participant) {
+  float* bus = buses[participant].data();
+  float* send_bus = send_buses[participant].data();
+  memset(bus, 0, length * sizeof(float));
+  memset(send_bus, 0, length * sizeof(float));
+  for (int i=participant; i < voices->size(); i += buses.size()) {
+    (*voices)[i]->render(bus, send_bus, global_frame, length);
+  }
+}
+
+void WorkerPool::setBufferSize(int size) {
+  for (auto& bus: buses) bus.resize(size);
+  for (auto& send_bus: send_buses) send_bus.resize(size);
+}
+
+void WorkerPool::render(const std::vector<VoiceBase*>& active_voices, float* out, float* send, int frame, int nframes) {
+  voices = &active_voices;
+  global_frame = frame;
+  length = nframes;
+  int busy = 0;
+  for (auto worker: workers) {
+    if (worker->participant >= active_voices.size()) break;
+    sem_post(&worker->wake);
+    ++busy;
+  }
+  renderShare(0);
+  for (int i=0; i < busy; ++i) sem_wait(&done);
+  for (int participant=0; participant <= busy; ++participant) {
+    const float* bus = buses[participant].data();
+    const float* send_bus = send_buses[participant].data();
+    for (int i=0; i < nframes; ++i) out[i] += bus[i];
+    for (int i=0; i < nframes; ++i) send[i] += send_bus[i];
+  }
+}
@@ -0,0 +1,44 @@
+#ifndef JACK_MIDI_SYNTH_WORKER_POOL_H
+#define JACK_MIDI_SYNTH_WORKER_POOL_H
+
+#include <vector>
+
+#include <pthread.h>
+#include <semaphore.h>
+
+class VoiceBase;
+
+// Renders the active voices of a cycle across a fixed set of threads started
+// up front. Voice i goes to participant i % (threads + 1), where participant
+// 0 is the calling thread, and every participant mixes into its own bus
+// and send bus.
+// The buses are then summed in participant order, so the result only
+// depends on the voice order and not on how the threads were scheduled.
+class WorkerPool {
+  private:
+    struct Worker {
+      WorkerPool* pool;
+      int participant;
+      pthread_t thread;
+      sem_t wake;
+    };
+    std::vector<Worker*> workers;
+    std::vector<std::vector<float> > buses;
+    std::vector<std::vector<float> > send_buses;
+    sem_t done;
+    bool running;
+    const std::vector<VoiceBase*>* voices;
+    int global_frame;
+    int length;
+    static void* static_work(void*);
+    void work(Worker*);
+    void renderShare(int);
+  public:
+    WorkerPool(int, int);
+    ~WorkerPool();
+    int getParticipants() const { return buses.size(); }
+    void setBufferSize(int);
+    void render(const std::vector<VoiceBase*>&, float*, float*, int, int);
+};
+
+#endif // JACK_MIDI_SYNTH_WORKER_POOL_H